@@ -1,4 +1,16 @@
-//g++ -std=c++17 -o rpsls_game rpsls_game.cpp
+//g++ -std=c++17 -pthread -o rpsls_game rpsls_game.cpp
+//g++ -std=c++17 -pthread -DRPSLS_COUNT_ALLOCATIONS ...  - счётчик operator new для --check-allocations
+//./rpsls_game [--seed N] [--elimination min|bottom:F|top:K|ratio:R]
+//             [--group-size G] [--threads T] [--quiet] [--profile] [--trace FILE]
+//             [--metrics PORT|unix:PATH] [--check-allocations] [--check-metrics]
+//             [--evolve generations=N,population=P,tournaments=T,team=K,field=F,out=FILE]
+//             [--replicator types=K,steps=S,dt=D,population=N,report=R]
+//             [--scoring auto|pairwise|histogram] [--verify-scoring rounds=N,max=M,large=L]
+//             [--bench threads=1:2:4,players=10:1000:100000,groups=4:16:0,pages=off:thp,
+//                      layout=pointer:packed,prefetch=0:4:8,format=csv|json,out=FILE]
+//             [--huge-pages off|thp|explicit] [--group-layout] [--prefetch D]
+//             [--what-if players=N,round=K,branches=B,player=S,choice=1-5]
+//             [--export FILE] [--io-backend auto|uring|pwrite] [--read-export FILE]
 
 #include <iostream>
 #include <string>
@@ -7,9 +19,320 @@
 #include <memory>
 #include <random>
 #include <algorithm>
+#include <utility>
+#include <optional>
 #include <functional>
 #include <limits>
 #include <set>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define RPSLS_HAVE_IO_URING
+#endif
+#if defined(__linux__) && __has_include(<linux/perf_event.h>) && defined(__NR_perf_event_open)
+#include <linux/perf_event.h>
+#define RPSLS_HAVE_PERF_EVENTS
+#endif
+
+
+// Счётчик вызовов глобального operator new. Считает только в сборке
+// с -DRPSLS_COUNT_ALLOCATIONS, иначе всегда 0.
+class AllocationCounter {
+public:
+    static constexpr bool enabled() {
+#ifdef RPSLS_COUNT_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+    
+    static size_t count() { return calls_.load(std::memory_order_relaxed); }
+    static void add() { calls_.fetch_add(1, std::memory_order_relaxed); }
+    
+private:
+    static inline std::atomic<size_t> calls_{0};
+};
+
+#ifdef RPSLS_COUNT_ALLOCATIONS
+// noinline: иначе GCC видит malloc/free сквозь new/delete и ругается на несоответствие
+[[gnu::noinline]] void* operator new(std::size_t size) {
+    AllocationCounter::add();
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* ptr) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+#endif
+
+
+// Страницы 2 МБ для объектов игроков и стратегий и для больших массивов
+// раунда. После жеребьёвки групп обращения к игрокам случайны, и на
+// миллионах игроков обычные страницы 4 КБ упираются в промахи TLB.
+// EXPLICIT - hugetlbfs (MAP_HUGETLB, нужен запас vm.nr_hugepages), при
+// отказе - как TRANSPARENT: выровненный mmap и madvise(MADV_HUGEPAGE).
+// Режим меняется только пока нет живых игроков и массивов: в начале main
+// и между прогонами --bench.
+class HugePages {
+public:
+    enum class Mode { OFF, TRANSPARENT, EXPLICIT };
+    
+    static constexpr size_t kPageSize = size_t{2} << 20;
+    static constexpr size_t kMinArray = kPageSize / 2;  // меньшие массивы - в обычной куче
+    static constexpr size_t kMaxObject = 512;           // крупные объекты - в обычной куче
+    
+    static Mode parse(const std::string& name) {
+        if (name == "off") return Mode::OFF;
+        if (name == "thp") return Mode::TRANSPARENT;
+        if (name == "explicit") return Mode::EXPLICIT;
+        throw std::invalid_argument("huge pages: off, thp или explicit, а не " + name);
+    }
+    
+    static const char* name(Mode mode) {
+        switch (mode) {
+            case Mode::TRANSPARENT: return "thp";
+            case Mode::EXPLICIT: return "explicit";
+            default: return "off";
+        }
+    }
+    
+    static Mode mode() { return mode_.load(std::memory_order_relaxed); }
+    
+    // Освобождает пулы объектов прошлого режима
+    static void setMode(Mode mode) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [slab, bytes] : slabs_) {
+            ::munmap(slab, bytes);
+        }
+        slabs_.clear();
+        freeLists_.fill(nullptr);
+        bump_ = nullptr;
+        left_ = 0;
+        mode_.store(mode, std::memory_order_relaxed);
+    }
+    
+    // Число отказов MAP_HUGETLB, после которых взяты прозрачные страницы
+    static size_t explicitFallbacks() { return fallbacks_.load(std::memory_order_relaxed); }
+    
+    static void* allocateArray(size_t bytes) {
+        if (mode() == Mode::OFF || bytes < kMinArray) {
+            return ::operator new(bytes);
+        }
+        return map(roundUp(bytes));
+    }
+    
+    static void deallocateArray(void* ptr, size_t bytes) noexcept {
+        if (mode() == Mode::OFF || bytes < kMinArray) {
+            ::operator delete(ptr);
+        } else {
+            ::munmap(ptr, roundUp(bytes));
+        }
+    }
+    
+    // Объекты нарезаются из плит по 2 МБ, освобождённые идут в список
+    // своего класса размера (кратно 16 байтам) и переиспользуются.
+    // Выровненные сильнее 16 байт (MetaStrategy) идут мимо пула.
+    static void* allocateObject(size_t bytes, size_t align = kObjectAlign) {
+        if (align > kObjectAlign) {
+            return ::operator new(bytes, std::align_val_t(align));
+        }
+        if (mode() == Mode::OFF || bytes > kMaxObject) {
+            return ::operator new(bytes);
+        }
+        size_t cls = (bytes + 15) / 16;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (void* head = freeLists_[cls]) {
+            freeLists_[cls] = *static_cast<void**>(head);
+            return head;
+        }
+        size_t size = cls * 16;
+        if (left_ < size) {
+            bump_ = static_cast<char*>(map(kPageSize));
+            left_ = kPageSize;
+            slabs_.emplace_back(bump_, kPageSize);
+        }
+        void* ptr = bump_;
+        bump_ += size;
+        left_ -= size;
+        return ptr;
+    }
+    
+    static void deallocateObject(void* ptr, size_t bytes, size_t align = kObjectAlign) noexcept {
+        if (align > kObjectAlign) {
+            ::operator delete(ptr, std::align_val_t(align));
+            return;
+        }
+        if (mode() == Mode::OFF || bytes > kMaxObject) {
+            ::operator delete(ptr);
+            return;
+        }
+        size_t cls = (bytes + 15) / 16;
+        std::lock_guard<std::mutex> lock(mutex_);
+        *static_cast<void**>(ptr) = freeLists_[cls];
+        freeLists_[cls] = ptr;
+    }
+    
+private:
+    static constexpr size_t kObjectAlign = 16;
+    
+    static size_t roundUp(size_t bytes) { return (bytes + kPageSize - 1) / kPageSize * kPageSize; }
+    
+    static void* map(size_t bytes) {
+        if (mode() == Mode::EXPLICIT) {
+            void* ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (ptr != MAP_FAILED) {
+                return ptr;
+            }
+            fallbacks_.fetch_add(1, std::memory_order_relaxed);
+        }
+        // Лишние 2 МБ, чтобы выровнять начало: THP собирает только выровненные страницы
+        size_t padded = bytes + kPageSize;
+        void* raw = ::mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        uintptr_t begin = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned = (begin + kPageSize - 1) / kPageSize * kPageSize;
+        if (aligned > begin) {
+            ::munmap(raw, aligned - begin);
+        }
+        ::munmap(reinterpret_cast<void*>(aligned + bytes), begin + padded - aligned - bytes);
+        ::madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+        return reinterpret_cast<void*>(aligned);
+    }
+    
+    static inline std::atomic<Mode> mode_{Mode::OFF};
+    static inline std::atomic<size_t> fallbacks_{0};
+    static inline std::mutex mutex_;
+    static inline std::vector<std::pair<void*, size_t>> slabs_;
+    static inline std::array<void*, kMaxObject / 16 + 1> freeLists_{};
+    static inline char* bump_ = nullptr;
+    static inline size_t left_ = 0;
+};
+
+// Аллокатор контейнеров поверх HugePages::allocateArray
+template <typename T>
+struct HugePageAllocator {
+    using value_type = T;
+    
+    HugePageAllocator() = default;
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U>&) {}
+    
+    T* allocate(size_t n) { return static_cast<T*>(HugePages::allocateArray(n * sizeof(T))); }
+    void deallocate(T* ptr, size_t n) noexcept { HugePages::deallocateArray(ptr, n * sizeof(T)); }
+    
+    template <typename U>
+    bool operator==(const HugePageAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const HugePageAllocator<U>&) const { return false; }
+};
+
+// Непрерывная память для игроков, переложенных в порядке групп раунда
+// (--group-layout). Объекты идут подряд в кусках по 2 МБ (на больших
+// страницах, если они включены); память освобождается только вся разом,
+// деструкторы вызывают владельцы через LayoutDeleter.
+class LayoutArena {
+public:
+    LayoutArena() = default;
+    LayoutArena(LayoutArena&& other) noexcept { *this = std::move(other); }
+    LayoutArena& operator=(LayoutArena&& other) noexcept {
+        if (this != &other) {
+            release();
+            chunks_ = std::move(other.chunks_);
+            next_ = std::exchange(other.next_, nullptr);
+            left_ = std::exchange(other.left_, 0);
+            other.chunks_.clear();
+        }
+        return *this;
+    }
+    ~LayoutArena() { release(); }
+    
+    void* allocate(size_t bytes, size_t align) {
+        size_t pad = (align - reinterpret_cast<uintptr_t>(next_) % align) % align;
+        if (left_ < pad + bytes) {
+            size_t size = std::max(HugePages::kPageSize, bytes + align);
+            next_ = static_cast<char*>(HugePages::allocateArray(size));
+            left_ = size;
+            chunks_.emplace_back(next_, size);
+            pad = (align - reinterpret_cast<uintptr_t>(next_) % align) % align;
+        }
+        void* ptr = next_ + pad;
+        next_ += pad + bytes;
+        left_ -= pad + bytes;
+        return ptr;
+    }
+    
+    // Перемещает объект в арену; старый остаётся пустым, его удаляет владелец
+    template <typename T>
+    T* relocate(T& object) {
+        return ::new (allocate(sizeof(T), alignof(T))) T(std::move(object));
+    }
+    
+private:
+    std::vector<std::pair<char*, size_t>> chunks_;
+    char* next_ = nullptr;
+    size_t left_ = 0;
+    
+    void release() {
+        for (const auto& [chunk, size] : chunks_) {
+            HugePages::deallocateArray(chunk, size);
+        }
+        chunks_.clear();
+        next_ = nullptr;
+        left_ = 0;
+    }
+};
+
+// Удаляет объект из кучи или только разрушает переложенный в LayoutArena
+template <typename T>
+struct LayoutDeleter {
+    enum Where : uint8_t { HEAP, CURRENT, RETIRED };  // CURRENT - арена раунда, RETIRED - выбывших
+    Where where = HEAP;
+    
+    LayoutDeleter() = default;
+    LayoutDeleter(Where place) : where(place) {}
+    
+    void operator()(T* ptr) const {
+        if (where == HEAP) {
+            delete ptr;
+        } else {
+            ptr->~T();
+        }
+    }
+};
 
 
 enum class Choice {
@@ -22,6 +345,10 @@ enum class Choice {
 
 class ChoiceHelper {
 public:
+    static constexpr size_t kCount = 5;
+    
+    static size_t index(Choice choice) { return static_cast<size_t>(choice); }
+    
     static std::string toString(Choice choice) {
         static const std::map<Choice, std::string> names = {
             {Choice::ROCK, "Камень"},
@@ -49,7 +376,7 @@ public:
         throw std::invalid_argument("Invalid input");
     }
     
-    static std::vector<Choice> allChoices() {
+    static constexpr std::array<Choice, kCount> allChoices() {
         return {Choice::ROCK, Choice::SCISSORS, Choice::PAPER, 
                 Choice::LIZARD, Choice::SPOCK};
     }
@@ -90,7 +417,40 @@ private:
         return wins;
     }
 
+    // Чем бить выбор (порядок вариантов важен для воспроизводимости)
+    static constexpr Choice kCounters[ChoiceHelper::kCount][2] = {
+        {Choice::PAPER, Choice::SPOCK},     // Камень
+        {Choice::ROCK, Choice::SPOCK},      // Ножницы
+        {Choice::SCISSORS, Choice::LIZARD}, // Бумага
+        {Choice::ROCK, Choice::SCISSORS},   // Ящерица
+        {Choice::LIZARD, Choice::PAPER}     // Спок
+    };
+    
+    // Бит d в kBeats[c] - c побеждает d (порядок как в enum Choice)
+    static constexpr uint8_t kBeats[ChoiceHelper::kCount] = {
+        0b01010,  // Камень: ножницы, ящерица
+        0b01100,  // Ножницы: бумага, ящерица
+        0b10001,  // Бумага: камень, Спок
+        0b10100,  // Ящерица: бумага, Спок
+        0b00011   // Спок: камень, ножницы
+    };
+
 public:
+    // Два выбора, побеждающих target
+    static const Choice (&counters(Choice target))[2] {
+        return kCounters[ChoiceHelper::index(target)];
+    }
+    
+    // Табличная проверка без поиска по map, для горячих циклов подсчёта
+    static bool beats(Choice choice1, Choice choice2) {
+        return (kBeats[ChoiceHelper::index(choice1)] >> ChoiceHelper::index(choice2)) & 1;
+    }
+    
+    // Выигрыш choice1 против choice2: 1, -1 или 0 при ничьей
+    static int payoff(Choice choice1, Choice choice2) {
+        return beats(choice1, choice2) ? 1 : beats(choice2, choice1) ? -1 : 0;
+    }
+    
     static DuelResult compare(Choice choice1, Choice choice2) {
         if (choice1 == choice2) {
             return DuelResult::DRAW;
@@ -115,26 +475,357 @@ public:
 };
 
 
+// Делит [0, n) на chunks непрерывных кусков и обрабатывает их параллельно.
+// body(begin, end, chunkIndex). Куски раздаются пулу рабочих потоков,
+// живущему весь процесс: запуск потока на каждый вызов стоил столько же,
+// сколько работа на пороге параллельности, и выделял память в каждом
+// раунде. Вызывающий поток сам берёт куски, пока они есть, поэтому
+// одновременные вызовы (спекуляция ходов) не ждут друг друга вхолостую.
+class Parallel {
+public:
+    static size_t chunkCount(size_t n, unsigned threads, size_t minChunk) {
+        return std::max<size_t>(1, std::min<size_t>(threads, n / minChunk));
+    }
+    
+    template <typename Body>
+    static void forChunks(size_t n, size_t chunks, Body&& body) {
+        auto run = [&](size_t c) {
+            body(n * c / chunks, n * (c + 1) / chunks, c);
+        };
+        if (chunks <= 1) {
+            run(0);
+            return;
+        }
+        Job job;
+        job.call = [](void* context, size_t c) { (*static_cast<decltype(run)*>(context))(c); };
+        job.context = &run;
+        job.chunks = chunks;
+        pool().execute(job);
+    }
+    
+    // Запускает рабочие заранее: профилировщик открывает на них счётчики
+    static void reserveWorkers(size_t count) { pool().grow(count); }
+    
+    // id рабочих потоков (gettid) в порядке запуска
+    static std::vector<pid_t> workerTids() { return pool().tids(); }
+    
+private:
+    // Вызов forChunks; живёт на стеке вызывающего, пул держит только указатель.
+    // Поля меняются под мьютексом пула.
+    struct Job {
+        void (*call)(void*, size_t) = nullptr;
+        void* context = nullptr;
+        size_t chunks = 0;
+        size_t next = 0;      // следующий кусок к раздаче
+        size_t done = 0;
+        Job* older = nullptr; // список активных вызовов
+    };
+    
+    class Pool {
+    public:
+        Pool() = default;
+        ~Pool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            wake_.notify_all();
+            for (auto& thread : threads_) {
+                thread.join();
+            }
+        }
+        
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+        
+        // noexcept: исключение из куска, как и прежде с std::thread, завершает
+        // процесс, а не оставляет в списке ссылку на снятый со стека вызов
+        void execute(Job& job) noexcept {
+            grow(job.chunks - 1);
+            std::unique_lock<std::mutex> lock(mutex_);
+            job.older = jobs_;
+            jobs_ = &job;
+            wake_.notify_all();
+            
+            while (job.next < job.chunks) {
+                size_t chunk = job.next++;
+                lock.unlock();
+                job.call(job.context, chunk);
+                lock.lock();
+                job.done++;
+            }
+            Job** link = &jobs_;
+            while (*link != &job) {
+                link = &(*link)->older;
+            }
+            *link = job.older;
+            finished_.wait(lock, [&job]() { return job.done == job.chunks; });
+        }
+        
+        void grow(size_t count) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (threads_.size() < count) {
+                tids_.push_back(0);
+                threads_.emplace_back([this, index = threads_.size()]() { work(index); });
+            }
+        }
+        
+        std::vector<pid_t> tids() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            finished_.wait(lock, [this]() {
+                return std::find(tids_.begin(), tids_.end(), 0) == tids_.end();
+            });
+            return tids_;
+        }
+        
+    private:
+        std::mutex mutex_;
+        std::condition_variable wake_;      // появились куски или остановка
+        std::condition_variable finished_;  // вызов доделан или рабочий запустился
+        std::vector<std::thread> threads_;
+        std::vector<pid_t> tids_;
+        Job* jobs_ = nullptr;
+        bool stop_ = false;
+        
+        Job* available() const {
+            for (Job* job = jobs_; job; job = job->older) {
+                if (job->next < job->chunks) {
+                    return job;
+                }
+            }
+            return nullptr;
+        }
+        
+        void work(size_t index) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            tids_[index] = static_cast<pid_t>(::syscall(SYS_gettid));
+            finished_.notify_all();
+            while (true) {
+                Job* job = nullptr;
+                wake_.wait(lock, [&]() { return stop_ || (job = available()) != nullptr; });
+                if (stop_) {
+                    return;
+                }
+                size_t chunk = job->next++;
+                lock.unlock();
+                job->call(job->context, chunk);
+                lock.lock();
+                if (++job->done == job->chunks) {
+                    finished_.notify_all();
+                }
+            }
+        }
+    };
+    
+    static Pool& pool() {
+        static Pool instance;
+        return instance;
+    }
+};
+
+
+// Ключ случайного потока: зерно турнира + координаты выбора.
+// Один и тот же ключ всегда даёт одну и ту же последовательность,
+// независимо от порядка вызовов и числа потоков.
+struct DrawKey {
+    // Потоки, не привязанные к игроку/группе (жеребьёвка, раздача стратегий)
+    static constexpr uint32_t kService = std::numeric_limits<uint32_t>::max();
+    
+    // Служебные потоки с одинаковыми координатами различаются полем stream,
+    // а не номером переигровки
+    enum Stream : uint32_t { PLAY, EVOLUTION, REPLICATOR_INIT, REPLICATOR_DRIFT, WHAT_IF };
+
+    uint64_t seed = 0;
+    uint32_t round = 0;
+    uint32_t group = 0;
+    uint32_t player = 0;
+    uint32_t attempt = 0;  // номер переигровки внутри группы
+    uint32_t stream = PLAY;
+};
+
+// Счётчиковый генератор Philox4x32-10 (Salmon et al., Random123).
+// Значение блока - чистая функция от (ключ, счётчик), состояние не хранится,
+// поэтому любой выбор можно посчитать независимо на любом потоке.
+class CounterRng {
+public:
+    using result_type = uint32_t;
+    using Block = std::array<uint32_t, 4>;
+    
+    explicit CounterRng(const DrawKey& key) : key_(key) {}
+    
+    // Первый блок уже посчитан пакетно (generateBulk)
+    CounterRng(const DrawKey& key, const Block& first)
+        : key_(key), block_(first), nextBlock_(1), pos_(0) {}
+    
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    
+    // Номер блока - целое слово счётчика: поток не повторяется в пределах
+    // kMaxBlocks блоков (2^34 чисел), дальше - ошибка, а не тихий цикл
+    static constexpr uint64_t kMaxBlocks = uint64_t{1} << 32;
+    static constexpr uint64_t kMaxDraws = kMaxBlocks * 4;
+    
+    result_type operator()() {
+        if (pos_ == block_.size()) {
+            if (nextBlock_ == kMaxBlocks) {
+                throw std::length_error("случайный поток исчерпан");
+            }
+            block_ = generate(key_, static_cast<uint32_t>(nextBlock_++));
+            pos_ = 0;
+        }
+        return block_[pos_++];
+    }
+    
+    // Равномерное число в [0, 1) с 24 значащими битами
+    float uniform() {
+        return static_cast<float>((*this)() >> 8) * 0x1p-24f;
+    }
+    
+    // Равномерное число в [0, range) без смещения.
+    // Lemire, "Fast Random Integer Generation in an Interval": деление
+    // нужно только при редком отбраковывании.
+    uint32_t below(uint32_t range) {
+        uint64_t m = uint64_t{(*this)()} * range;
+        uint32_t low = static_cast<uint32_t>(m);
+        if (low < range) {
+            uint32_t threshold = (0u - range) % range;
+            while (low < threshold) {
+                m = uint64_t{(*this)()} * range;
+                low = static_cast<uint32_t>(m);
+            }
+        }
+        return static_cast<uint32_t>(m >> 32);
+    }
+    
+    // Счётчик: {номер блока, игрок, группа, раунд}, ключ - streamKey
+    static Block generate(const DrawKey& key, uint32_t blockIndex) {
+        uint64_t k = streamKey(key);
+        return philox({blockIndex, key.player, key.group, key.round},
+                      static_cast<uint32_t>(k), static_cast<uint32_t>(k >> 32));
+    }
+    
+    // Ключ Philox: зерно XOR биекция (финализатор splitmix64) от пары
+    // (переигровка, поток). При одном зерне разные пары - разные ключи,
+    // а малые зёрна не совпадают с чужими ключами, как было бы при
+    // простом XOR упакованной пары.
+    static uint64_t streamKey(const DrawKey& key) {
+        uint64_t z = uint64_t{key.attempt} << 32 | key.stream;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return key.seed ^ z ^ (z >> 31);
+    }
+    
+    // Первые блоки потоков для n игроков с общим ключом (раунд/группа/переигровка).
+    // Дорожки обрабатываются независимыми массивами по kLanes, цикл без
+    // ветвлений компилятор разворачивает в SIMD (vpmuludq на AVX2).
+    static void generateBulk(const DrawKey& key, const uint32_t* players, size_t n, Block* out) {
+        constexpr size_t kLanes = 8;
+        const uint64_t k = streamKey(key);
+        for (size_t base = 0; base < n; base += kLanes) {
+            size_t lanes = std::min(kLanes, n - base);
+            uint32_t x0[kLanes], x1[kLanes], x2[kLanes], x3[kLanes];
+            for (size_t i = 0; i < kLanes; ++i) {
+                x0[i] = 0;
+                x1[i] = i < lanes ? players[base + i] : 0;
+                x2[i] = key.group;
+                x3[i] = key.round;
+            }
+            uint32_t k0 = static_cast<uint32_t>(k);
+            uint32_t k1 = static_cast<uint32_t>(k >> 32);
+            for (int r = 0; r < 10; ++r) {
+                for (size_t i = 0; i < kLanes; ++i) {
+                    uint64_t p0 = uint64_t{0xD2511F53} * x0[i];
+                    uint64_t p1 = uint64_t{0xCD9E8D57} * x2[i];
+                    uint32_t y0 = static_cast<uint32_t>(p1 >> 32) ^ x1[i] ^ k0;
+                    uint32_t y2 = static_cast<uint32_t>(p0 >> 32) ^ x3[i] ^ k1;
+                    x1[i] = static_cast<uint32_t>(p1);
+                    x3[i] = static_cast<uint32_t>(p0);
+                    x0[i] = y0;
+                    x2[i] = y2;
+                }
+                k0 += 0x9E3779B9;
+                k1 += 0xBB67AE85;
+            }
+            for (size_t i = 0; i < lanes; ++i) {
+                out[base + i] = {x0[i], x1[i], x2[i], x3[i]};
+            }
+        }
+    }
+    
+    static Block philox(Block c, uint32_t k0, uint32_t k1) {
+        for (int i = 0; i < 10; ++i) {
+            uint64_t p0 = uint64_t{0xD2511F53} * c[0];
+            uint64_t p1 = uint64_t{0xCD9E8D57} * c[2];
+            c = {static_cast<uint32_t>(p1 >> 32) ^ c[1] ^ k0, static_cast<uint32_t>(p1),
+                 static_cast<uint32_t>(p0 >> 32) ^ c[3] ^ k1, static_cast<uint32_t>(p0)};
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+        return c;
+    }
+    
+private:
+    DrawKey key_;
+    Block block_{};
+    uint64_t nextBlock_ = 0;
+    size_t pos_ = 4;
+};
+
+
 class ChoiceStrategy {
 public:
     virtual ~ChoiceStrategy() = default;
-    virtual Choice makeChoice(const std::vector<Choice>& history) = 0;
+    
+    static void* operator new(size_t size) { return HugePages::allocateObject(size); }
+    static void* operator new(size_t size, std::align_val_t align) {
+        return HugePages::allocateObject(size, static_cast<size_t>(align));
+    }
+    static void operator delete(void* ptr, size_t size) noexcept {
+        HugePages::deallocateObject(ptr, size);
+    }
+    static void operator delete(void* ptr, size_t size, std::align_val_t align) noexcept {
+        HugePages::deallocateObject(ptr, size, static_cast<size_t>(align));
+    }
+    virtual Choice makeChoice(const std::vector<Choice>& history, CounterRng& rng) = 0;
     virtual std::string getName() const = 0;
+    
+    // Заранее выделить память под ожидаемое число ходов (для стратегий,
+    // чьё состояние растёт с историей)
+    virtual void reserveHistory(size_t) {}
+    
+    // Ход номер move - чистая функция move, а history не читается: игроку
+    // достаточно хранить число ходов, историю восстанавливает historyAt
+    virtual bool hasImplicitHistory() const { return false; }
+    virtual Choice historyAt(size_t /*move*/) const {
+        throw std::logic_error("история стратегии " + getName() + " не восстанавливается");
+    }
+    
+    // Итог попытки раунда для сделанного выбора: победы/поражения против
+    // opponents соперников группы (включая ничьи-переигровки)
+    virtual void observeResult(Choice, int /*wins*/, int /*losses*/, int /*opponents*/) {}
+    
+    // Перемещает стратегию в арену (--group-layout)
+    virtual ChoiceStrategy* relocate(LayoutArena& arena) = 0;
+    // Независимая копия состояния - для ветвления турнира (Game::fork)
+    virtual std::unique_ptr<ChoiceStrategy> clone() const = 0;
+    
+protected:
+    // Выигрыш попытки в [0, 1]: 0 - проиграл всем, 1 - победил всех
+    static float reward(int wins, int losses, int opponents) {
+        return 0.5f + 0.5f * static_cast<float>(wins - losses) / static_cast<float>(opponents);
+    }
 };
 
 class RandomStrategy : public ChoiceStrategy {
-private:
-    std::mt19937 rng;
-    
 public:
-    RandomStrategy() : rng(std::random_device{}()) {}
-    
-    Choice makeChoice(const std::vector<Choice>&) override {
+    Choice makeChoice(const std::vector<Choice>&, CounterRng& rng) override {
         auto choices = ChoiceHelper::allChoices();
-        std::uniform_int_distribution<size_t> dist(0, choices.size() - 1);
-        return choices[dist(rng)];
+        return choices[rng.below(static_cast<uint32_t>(choices.size()))];
     }
     
+    ChoiceStrategy* relocate(LayoutArena& arena) override { return arena.relocate(*this); }
+    std::unique_ptr<ChoiceStrategy> clone() const override { return std::make_unique<RandomStrategy>(*this); }
+    
     std::string getName() const override {
         return "Случайная";
     }
@@ -142,31 +833,41 @@ public:
 
 class BiasedStrategy : public ChoiceStrategy {
 private:
-    std::mt19937 rng;
-    std::map<Choice, int> weights;
+    // Накопленные веса в порядке enum Choice: выбор - первый с cumulative > r
+    std::array<uint32_t, ChoiceHelper::kCount> cumulative{};
     
 public:
-    BiasedStrategy() : rng(std::random_device{}()) {
-        weights = {
-            {Choice::ROCK, 2},
-            {Choice::PAPER, 2},
-            {Choice::SCISSORS, 2},
-            {Choice::LIZARD, 1},
-            {Choice::SPOCK, 1}
-        };
+    using Weights = std::array<uint32_t, ChoiceHelper::kCount>;
+    
+    static constexpr Weights kDefaultWeights = {
+        2,  // Камень
+        2,  // Ножницы
+        2,  // Бумага
+        1,  // Ящерица
+        1   // Спок
+    };
+    
+    // Веса в порядке enum Choice, хотя бы один ненулевой
+    explicit BiasedStrategy(const Weights& weights = kDefaultWeights) {
+        uint32_t total = 0;
+        for (size_t c = 0; c < weights.size(); ++c) {
+            total += weights[c];
+            cumulative[c] = total;
+        }
     }
     
-    Choice makeChoice(const std::vector<Choice>&) override {
-        std::vector<Choice> pool;
-        for (const auto& [choice, weight] : weights) {
-            for (int i = 0; i < weight; ++i) {
-                pool.push_back(choice);
-            }
+    Choice makeChoice(const std::vector<Choice>&, CounterRng& rng) override {
+        uint32_t r = rng.below(cumulative.back());
+        size_t c = 0;
+        while (cumulative[c] <= r) {
+            ++c;
         }
-        std::uniform_int_distribution<size_t> dist(0, pool.size() - 1);
-        return pool[dist(rng)];
+        return static_cast<Choice>(c);
     }
     
+    ChoiceStrategy* relocate(LayoutArena& arena) override { return arena.relocate(*this); }
+    std::unique_ptr<ChoiceStrategy> clone() const override { return std::make_unique<BiasedStrategy>(*this); }
+    
     std::string getName() const override {
         return "Взвешенная";
     }
@@ -174,49 +875,37 @@ public:
 
 class AdaptiveStrategy : public ChoiceStrategy {
 private:
-    std::mt19937 rng;
-    
-    Choice findCounter(Choice target) {
-        static const std::map<Choice, std::vector<Choice>> counters = {
-            {Choice::ROCK, {Choice::PAPER, Choice::SPOCK}},
-            {Choice::SCISSORS, {Choice::ROCK, Choice::SPOCK}},
-            {Choice::PAPER, {Choice::SCISSORS, Choice::LIZARD}},
-            {Choice::LIZARD, {Choice::ROCK, Choice::SCISSORS}},
-            {Choice::SPOCK, {Choice::LIZARD, Choice::PAPER}}
-        };
-        
-        const auto& options = counters.at(target);
-        std::uniform_int_distribution<size_t> dist(0, options.size() - 1);
-        return options[dist(rng)];
+    Choice findCounter(Choice target, CounterRng& rng) {
+        return GameRules::counters(target)[rng.below(2)];
     }
     
 public:
-    AdaptiveStrategy() : rng(std::random_device{}()) {}
-    
-    Choice makeChoice(const std::vector<Choice>& history) override {
+    Choice makeChoice(const std::vector<Choice>& history, CounterRng& rng) override {
         if (history.size() < 3) {
             auto choices = ChoiceHelper::allChoices();
-            std::uniform_int_distribution<size_t> dist(0, choices.size() - 1);
-            return choices[dist(rng)];
+            return choices[rng.below(static_cast<uint32_t>(choices.size()))];
         }
         
-        std::map<Choice, int> counts;
+        std::array<int, ChoiceHelper::kCount> counts{};
         for (const auto& c : history) {
-            counts[c]++;
+            counts[ChoiceHelper::index(c)]++;
         }
         
         Choice mostCommon = history[0];
         int maxCount = 0;
-        for (const auto& [choice, count] : counts) {
-            if (count > maxCount) {
-                maxCount = count;
-                mostCommon = choice;
+        for (size_t c = 0; c < counts.size(); ++c) {
+            if (counts[c] > maxCount) {
+                maxCount = counts[c];
+                mostCommon = static_cast<Choice>(c);
             }
         }
         
-        return findCounter(mostCommon);
+        return findCounter(mostCommon, rng);
     }
     
+    ChoiceStrategy* relocate(LayoutArena& arena) override { return arena.relocate(*this); }
+    std::unique_ptr<ChoiceStrategy> clone() const override { return std::make_unique<AdaptiveStrategy>(*this); }
+    
     std::string getName() const override {
         return "Адаптивная";
     }
@@ -225,101 +914,559 @@ public:
 class CyclicStrategy : public ChoiceStrategy {
 private:
     size_t index = 0;
-    std::vector<Choice> cycle;
+    std::array<Choice, ChoiceHelper::kCount> cycle;
     
 public:
     CyclicStrategy() : cycle(ChoiceHelper::allChoices()) {}
     
-    Choice makeChoice(const std::vector<Choice>&) override {
+    Choice makeChoice(const std::vector<Choice>&, CounterRng&) override {
         Choice choice = cycle[index % cycle.size()];
         index++;
         return choice;
     }
     
+    bool hasImplicitHistory() const override { return true; }
+    Choice historyAt(size_t move) const override {
+        return cycle[move % cycle.size()];
+    }
+    
+    ChoiceStrategy* relocate(LayoutArena& arena) override { return arena.relocate(*this); }
+    std::unique_ptr<ChoiceStrategy> clone() const override { return std::make_unique<CyclicStrategy>(*this); }
+    
     std::string getName() const override {
         return "Циклическая";
     }
 };
 
-class Player {
-protected:
-    std::string name_;
-    std::vector<Choice> choiceHistory_;
-    bool isActive_ = true;
-    
-public:
-    explicit Player(const std::string& name) : name_(name) {}
-    virtual ~Player() = default;
-    
-    const std::string& getName() const { return name_; }
-    bool isActive() const { return isActive_; }
-    void setActive(bool active) { isActive_ = active; }
-    const std::vector<Choice>& getChoiceHistory() const { return choiceHistory_; }
+// Онлайн суффиксный автомат над историей ходов. Добавление хода -
+// амортизированно O(1); у каждого состояния хранится конец первого
+// вхождения, поэтому самый длинный повторившийся суффикс находится сразу.
+class SuffixAutomaton {
+private:
+    struct State {
+        int32_t len = 0;
+        int32_t link = -1;
+        int32_t firstEnd = -1;  // конец первого вхождения в историю
+        std::array<int32_t, ChoiceHelper::kCount> next;
+        
+        State() { next.fill(-1); }
+    };
     
-    void recordChoice(Choice choice) {
-        choiceHistory_.push_back(choice);
-    }
+    std::vector<State> states_ = std::vector<State>(1);
+    int32_t last_ = 0;
     
-    virtual Choice makeChoice() = 0;
-    virtual std::string getType() const = 0;
-    virtual bool isHuman() const = 0;
-};
-
-class HumanPlayer : public Player {
 public:
-    explicit HumanPlayer(const std::string& name) : Player(name) {}
-    
-    Choice makeChoice() override {
-        std::cout << "\n  " << name_ << ", сделайте выбор:\n";
-        std::cout << "    1. Камень\n";
-        std::cout << "    2. Ножницы\n";
-        std::cout << "    3. Бумага\n";
-        std::cout << "    4. Ящерица\n";
-        std::cout << "    5. Спок\n";
+    void extend(Choice choice, int32_t pos) {
+        size_t c = ChoiceHelper::index(choice);
+        int32_t cur = static_cast<int32_t>(states_.size());
+        states_.emplace_back();
+        states_[cur].len = states_[last_].len + 1;
+        states_[cur].firstEnd = pos;
         
-        while (true) {
-            std::cout << "  Ваш выбор (1-5): ";
-            std::string input;
-            std::getline(std::cin, input);
-            
-            input.erase(0, input.find_first_not_of(" \t"));
-            input.erase(input.find_last_not_of(" \t") + 1);
-            
-            try {
-                Choice choice = ChoiceHelper::fromInput(input);
-                recordChoice(choice);
-                return choice;
-            } catch (const std::invalid_argument&) {
-                std::cout << "  Неверный ввод. Попробуйте снова.\n";
+        int32_t p = last_;
+        while (p != -1 && states_[p].next[c] == -1) {
+            states_[p].next[c] = cur;
+            p = states_[p].link;
+        }
+        
+        if (p == -1) {
+            states_[cur].link = 0;
+        } else {
+            int32_t q = states_[p].next[c];
+            if (states_[p].len + 1 == states_[q].len) {
+                states_[cur].link = q;
+            } else {
+                int32_t clone = static_cast<int32_t>(states_.size());
+                states_.push_back(states_[q]);
+                states_[clone].len = states_[p].len + 1;
+                while (p != -1 && states_[p].next[c] == q) {
+                    states_[p].next[c] = clone;
+                    p = states_[p].link;
+                }
+                states_[q].link = clone;
+                states_[cur].link = clone;
             }
         }
+        last_ = cur;
     }
     
-    std::string getType() const override {
-        return "Человек";
+    // Конец первого вхождения самого длинного суффикса, встречавшегося
+    // раньше (суффиксная ссылка последнего состояния), или -1
+    int32_t matchEnd() const {
+        int32_t match = states_[last_].link;
+        return match > 0 ? states_[match].firstEnd : -1;
     }
     
-    bool isHuman() const override { return true; }
+    void reserve(size_t moves) {
+        states_.reserve(2 * moves + 1);
+    }
 };
 
-class ComputerPlayer : public Player {
+// Предсказание по истории (history matching): ищется самый длинный суффикс
+// истории, уже встречавшийся раньше, берётся выбор, последовавший за первым
+// его вхождением, и играется то, что его бьёт. Даже на историях из
+// миллионов ходов каждый ход - амортизированно O(1).
+class HistoryMatchStrategy : public ChoiceStrategy {
 private:
-    std::unique_ptr<ChoiceStrategy> strategy_;
+    SuffixAutomaton automaton_;
+    size_t consumed_ = 0;  // сколько ходов истории уже в автомате
     
 public:
-    ComputerPlayer(const std::string& name, std::unique_ptr<ChoiceStrategy> strategy)
-        : Player(name), strategy_(std::move(strategy)) {}
-    
-    Choice makeChoice() override {
-        Choice choice = strategy_->makeChoice(choiceHistory_);
+    Choice makeChoice(const std::vector<Choice>& history, CounterRng& rng) override {
+        for (; consumed_ < history.size(); ++consumed_) {
+            automaton_.extend(history[consumed_], static_cast<int32_t>(consumed_));
+        }
+        
+        int32_t end = automaton_.matchEnd();
+        if (end < 0) {
+            return ChoiceHelper::allChoices()[rng.below(ChoiceHelper::kCount)];
+        }
+        
+        Choice predicted = history[end + 1];
+        return GameRules::counters(predicted)[rng.below(2)];
+    }
+    
+    void reserveHistory(size_t moves) override {
+        automaton_.reserve(moves);
+    }
+    
+    ChoiceStrategy* relocate(LayoutArena& arena) override { return arena.relocate(*this); }
+    std::unique_ptr<ChoiceStrategy> clone() const override { return std::make_unique<HistoryMatchStrategy>(*this); }
+    
+    std::string getName() const override {
+        return "Поиск по истории";
+    }
+};
+
+// Мета-стратегия в духе Iocaine Powder. Базовые предсказатели (частоты,
+// цепи Маркова, поиск по истории, повтор) предсказывают следующий ход
+// истории; каждое предсказание p даёт три кандидата - бить p, бить ответ
+// на p, бить ответ на ответ (мета-слои 0/1/2). Каждый кандидат оценивается
+// с несколькими горизонтами затухания, и играется кандидат с лучшим счётом.
+// Все счета лежат одним плоским массивом и обновляются одним проходом,
+// который компилятор векторизует.
+class MetaStrategy : public ChoiceStrategy {
+private:
+    static constexpr size_t kPredictors = 6;
+    static constexpr size_t kRotations = 3;
+    static constexpr size_t kCandidates = kPredictors * kRotations;
+    static constexpr size_t kHorizons = 3;
+    static constexpr size_t kScores = kCandidates * kHorizons;
+    static constexpr float kHorizonDecay[kHorizons] = {0.5f, 0.9f, 0.99f};
+    
+    // Состояние базовых предсказателей
+    std::array<uint32_t, ChoiceHelper::kCount> counts_{};
+    std::array<float, ChoiceHelper::kCount> recent_{};
+    std::array<std::array<uint32_t, ChoiceHelper::kCount>, ChoiceHelper::kCount> markov1_{};
+    std::array<std::array<uint32_t, ChoiceHelper::kCount>,
+               ChoiceHelper::kCount * ChoiceHelper::kCount> markov2_{};
+    SuffixAutomaton automaton_;
+    size_t consumed_ = 0;
+    float recentDecay_;
+    
+    // Плоские массивы: слот i - кандидат i % kCandidates, горизонт i / kCandidates
+    alignas(32) std::array<float, kScores> scores_{};
+    alignas(32) std::array<float, kScores> decay_{};
+    alignas(32) std::array<uint8_t, kScores> suggestions_{};
+    bool hasSuggestions_ = false;
+    
+    template <typename Counts>
+    static Choice mostLikely(const Counts& counts) {
+        size_t best = 0;
+        for (size_t c = 1; c < counts.size(); ++c) {
+            if (counts[c] > counts[best]) {
+                best = c;
+            }
+        }
+        return static_cast<Choice>(best);
+    }
+    
+    static Choice beat(Choice choice) {
+        return GameRules::counters(choice)[0];
+    }
+    
+    // Счёт всех кандидатов за фактический ход: s = s * decay + выигрыш
+    void score(Choice actual) {
+        std::array<float, ChoiceHelper::kCount> payoff{};
+        for (size_t c = 0; c < ChoiceHelper::kCount; ++c) {
+            payoff[c] = static_cast<float>(GameRules::payoff(static_cast<Choice>(c), actual));
+        }
+        for (size_t i = 0; i < kScores; ++i) {
+            scores_[i] = scores_[i] * decay_[i] + payoff[suggestions_[i]];
+        }
+    }
+    
+    void learn(const std::vector<Choice>& history, size_t pos) {
+        Choice choice = history[pos];
+        size_t c = ChoiceHelper::index(choice);
+        counts_[c]++;
+        for (auto& r : recent_) {
+            r *= recentDecay_;
+        }
+        recent_[c] += 1.0f;
+        if (pos >= 1) {
+            markov1_[ChoiceHelper::index(history[pos - 1])][c]++;
+        }
+        if (pos >= 2) {
+            size_t context = ChoiceHelper::index(history[pos - 2]) * ChoiceHelper::kCount
+                           + ChoiceHelper::index(history[pos - 1]);
+            markov2_[context][c]++;
+        }
+        automaton_.extend(choice, static_cast<int32_t>(pos));
+    }
+    
+    void suggest(const std::vector<Choice>& history) {
+        size_t n = history.size();
+        Choice last = history[n - 1];
+        int32_t end = automaton_.matchEnd();
+        
+        std::array<Choice, kPredictors> predictions = {
+            mostLikely(counts_),
+            mostLikely(recent_),
+            mostLikely(markov1_[ChoiceHelper::index(last)]),
+            n >= 2 ? mostLikely(markov2_[ChoiceHelper::index(history[n - 2]) * ChoiceHelper::kCount
+                                         + ChoiceHelper::index(last)])
+                   : last,
+            end >= 0 ? history[end + 1] : last,
+            last
+        };
+        
+        for (size_t p = 0; p < kPredictors; ++p) {
+            Choice move = predictions[p];
+            for (size_t r = 0; r < kRotations; ++r) {
+                move = beat(move);
+                for (size_t h = 0; h < kHorizons; ++h) {
+                    suggestions_[h * kCandidates + p * kRotations + r] =
+                        static_cast<uint8_t>(ChoiceHelper::index(move));
+                }
+            }
+        }
+        hasSuggestions_ = true;
+    }
+    
+public:
+    // recentDecay - затухание частот предсказателя "недавние ходы"
+    explicit MetaStrategy(float recentDecay = 0.8f) : recentDecay_(recentDecay) {
+        for (size_t i = 0; i < kScores; ++i) {
+            decay_[i] = kHorizonDecay[i / kCandidates];
+        }
+    }
+    
+    Choice makeChoice(const std::vector<Choice>& history, CounterRng& rng) override {
+        for (; consumed_ < history.size(); ++consumed_) {
+            if (hasSuggestions_) {
+                score(history[consumed_]);
+            }
+            learn(history, consumed_);
+            suggest(history);
+        }
+        
+        if (!hasSuggestions_) {
+            return ChoiceHelper::allChoices()[rng.below(ChoiceHelper::kCount)];
+        }
+        
+        size_t best = static_cast<size_t>(
+            std::max_element(scores_.begin(), scores_.end()) - scores_.begin());
+        if (scores_[best] <= 0.0f) {
+            return ChoiceHelper::allChoices()[rng.below(ChoiceHelper::kCount)];
+        }
+        return static_cast<Choice>(suggestions_[best]);
+    }
+    
+    void reserveHistory(size_t moves) override {
+        automaton_.reserve(moves);
+    }
+    
+    ChoiceStrategy* relocate(LayoutArena& arena) override { return arena.relocate(*this); }
+    std::unique_ptr<ChoiceStrategy> clone() const override { return std::make_unique<MetaStrategy>(*this); }
+    
+    std::string getName() const override {
+        return "Мета-ансамбль";
+    }
+};
+
+// Многорукий бандит UCB1 (Auer et al.): выборы - ручки, награда - итог
+// попытки раунда. Состояние - суммы наград и число попыток, без истории.
+class Ucb1Strategy : public ChoiceStrategy {
+private:
+    std::array<float, ChoiceHelper::kCount> rewardSum_{};
+    std::array<uint32_t, ChoiceHelper::kCount> pulls_{};
+    uint32_t total_ = 0;
+    float exploration_;
+    
+public:
+    // exploration - вес бонуса исследования (2 в классическом UCB1)
+    explicit Ucb1Strategy(float exploration = 2.0f) : exploration_(exploration) {}
+    
+    Choice makeChoice(const std::vector<Choice>&, CounterRng&) override {
+        size_t best = 0;
+        float bestValue = -1.0f;
+        for (size_t c = 0; c < ChoiceHelper::kCount; ++c) {
+            if (pulls_[c] == 0) {
+                return static_cast<Choice>(c);
+            }
+            float value = rewardSum_[c] / pulls_[c]
+                        + std::sqrt(exploration_ * std::log(static_cast<float>(total_)) / pulls_[c]);
+            if (value > bestValue) {
+                bestValue = value;
+                best = c;
+            }
+        }
+        return static_cast<Choice>(best);
+    }
+    
+    void observeResult(Choice choice, int wins, int losses, int opponents) override {
+        size_t c = ChoiceHelper::index(choice);
+        rewardSum_[c] += reward(wins, losses, opponents);
+        pulls_[c]++;
+        total_++;
+    }
+    
+    ChoiceStrategy* relocate(LayoutArena& arena) override { return arena.relocate(*this); }
+    std::unique_ptr<ChoiceStrategy> clone() const override { return std::make_unique<Ucb1Strategy>(*this); }
+    
+    std::string getName() const override {
+        return "Бандит UCB1";
+    }
+};
+
+// Состязательный бандит Exp3 (Auer et al.): веса ручек в логарифмах,
+// доля gamma ходов - равномерное исследование.
+class Exp3Strategy : public ChoiceStrategy {
+private:
+    std::array<float, ChoiceHelper::kCount> logWeights_{};
+    float gamma_;
+    
+    float probability(size_t c) const {
+        float maxLog = *std::max_element(logWeights_.begin(), logWeights_.end());
+        float sum = 0.0f;
+        for (float w : logWeights_) {
+            sum += std::exp(w - maxLog);
+        }
+        return (1.0f - gamma_) * std::exp(logWeights_[c] - maxLog) / sum
+             + gamma_ / ChoiceHelper::kCount;
+    }
+    
+public:
+    explicit Exp3Strategy(float gamma = 0.1f) : gamma_(gamma) {}
+    
+    Choice makeChoice(const std::vector<Choice>&, CounterRng& rng) override {
+        float u = rng.uniform();
+        for (size_t c = 0; c + 1 < ChoiceHelper::kCount; ++c) {
+            u -= probability(c);
+            if (u < 0.0f) {
+                return static_cast<Choice>(c);
+            }
+        }
+        return static_cast<Choice>(ChoiceHelper::kCount - 1);
+    }
+    
+    void observeResult(Choice choice, int wins, int losses, int opponents) override {
+        size_t c = ChoiceHelper::index(choice);
+        float estimate = reward(wins, losses, opponents) / probability(c);
+        logWeights_[c] += gamma_ * estimate / ChoiceHelper::kCount;
+    }
+    
+    ChoiceStrategy* relocate(LayoutArena& arena) override { return arena.relocate(*this); }
+    std::unique_ptr<ChoiceStrategy> clone() const override { return std::make_unique<Exp3Strategy>(*this); }
+    
+    std::string getName() const override {
+        return "Бандит Exp3";
+    }
+};
+
+class Player {
+protected:
+    uint32_t id_;
+    std::string name_;
+    // У ботов с восстановимой историей пуст, пока её не восстановят
+    // (ComputerPlayer::materializeHistory) - до тех пор ведётся только moveCount_
+    std::vector<Choice> choiceHistory_;
+    size_t moveCount_ = 0;
+    bool isActive_ = true;
+    int eliminatedRound_ = 0;
+    
+public:
+    Player(uint32_t id, const std::string& name) : id_(id), name_(name) {}
+    Player(const Player&) = default;
+    Player(Player&&) = default;
+    virtual ~Player() = default;
+    
+    static void* operator new(size_t size) { return HugePages::allocateObject(size); }
+    static void* operator new(size_t size, std::align_val_t align) {
+        return HugePages::allocateObject(size, static_cast<size_t>(align));
+    }
+    static void operator delete(void* ptr, size_t size) noexcept {
+        HugePages::deallocateObject(ptr, size);
+    }
+    static void operator delete(void* ptr, size_t size, std::align_val_t align) noexcept {
+        HugePages::deallocateObject(ptr, size, static_cast<size_t>(align));
+    }
+    
+    uint32_t getId() const { return id_; }
+    const std::string& getName() const { return name_; }
+    bool isActive() const { return isActive_; }
+    void setActive(bool active) { isActive_ = active; }
+    
+    // Выбыл в раунде round (0 - ещё в игре)
+    void eliminate(int round) {
+        isActive_ = false;
+        eliminatedRound_ = round;
+    }
+    int getEliminatedRound() const { return eliminatedRound_; }
+    size_t getMoveCount() const { return moveCount_; }
+    const std::vector<Choice>& getChoiceHistory() const { return choiceHistory_; }
+    
+    void recordChoice(Choice choice) {
+        choiceHistory_.push_back(choice);
+        moveCount_++;
+    }
+    
+    virtual Choice makeChoice(CounterRng& rng) = 0;
+    virtual std::string getType() const = 0;
+    virtual bool isHuman() const = 0;
+    
+    virtual void observeResult(Choice, int /*wins*/, int /*losses*/, int /*opponents*/) {}
+    
+    // Заранее выделить память под moves ходов (--check-allocations)
+    virtual void reserveHistory(size_t moves) { choiceHistory_.reserve(moves); }
+    
+    // Перемещает игрока (и его стратегию) в арену, прежний объект пустеет
+    virtual Player* relocate(LayoutArena& arena) = 0;
+    // Независимая копия со стратегией и историей (Game::fork)
+    virtual std::unique_ptr<Player> clone() const = 0;
+    
+    // Подкачка в кэш до хода группы (--prefetch). Сам объект - без чтения
+    // его памяти; prefetchState читает объект, поэтому зовётся позже, когда
+    // он уже подкачан, и подкачивает то, на что он указывает.
+    void prefetchObject() const {
+        __builtin_prefetch(this);
+        __builtin_prefetch(reinterpret_cast<const char*>(this) + 64);
+    }
+    virtual void prefetchState() const {}
+};
+
+class HumanPlayer : public Player {
+public:
+    HumanPlayer(uint32_t id, const std::string& name) : Player(id, name) {}
+    
+    Choice makeChoice(CounterRng&) override {
+        std::cout << "\n  " << name_ << ", сделайте выбор:\n";
+        std::cout << "    1. Камень\n";
+        std::cout << "    2. Ножницы\n";
+        std::cout << "    3. Бумага\n";
+        std::cout << "    4. Ящерица\n";
+        std::cout << "    5. Спок\n";
+        
+        while (true) {
+            std::cout << "  Ваш выбор (1-5): ";
+            std::string input;
+            std::getline(std::cin, input);
+            
+            input.erase(0, input.find_first_not_of(" \t"));
+            input.erase(input.find_last_not_of(" \t") + 1);
+            
+            try {
+                Choice choice = ChoiceHelper::fromInput(input);
+                recordChoice(choice);
+                return choice;
+            } catch (const std::invalid_argument&) {
+                std::cout << "  Неверный ввод. Попробуйте снова.\n";
+            }
+        }
+    }
+    
+    std::string getType() const override {
+        return "Человек";
+    }
+    
+    Player* relocate(LayoutArena& arena) override { return arena.relocate(*this); }
+    std::unique_ptr<Player> clone() const override { return std::make_unique<HumanPlayer>(*this); }
+    
+    bool isHuman() const override { return true; }
+};
+
+class ComputerPlayer : public Player {
+private:
+    std::unique_ptr<ChoiceStrategy, LayoutDeleter<ChoiceStrategy>> strategy_;
+    bool implicitHistory_;
+    std::optional<Choice> forced_;
+    
+    static inline const std::vector<Choice> kNoHistory;
+    
+public:
+    ComputerPlayer(uint32_t id, const std::string& name, std::unique_ptr<ChoiceStrategy> strategy)
+        : Player(id, name), strategy_(strategy.release()),
+          implicitHistory_(strategy_->hasImplicitHistory()) {}
+    
+    ComputerPlayer(const ComputerPlayer& other)
+        : Player(other), strategy_(other.strategy_->clone().release()),
+          implicitHistory_(other.implicitHistory_), forced_(other.forced_) {}
+    ComputerPlayer(ComputerPlayer&&) = default;
+    
+    // Следующий ход - choice вместо хода стратегии (ветки "что если").
+    // Стратегия узнает о нём через observeResult, как о своём.
+    void forceNextChoice(Choice choice) { forced_ = choice; }
+    
+    Choice makeChoice(CounterRng& rng) override {
+        if (forced_) {
+            // История стратегии больше не восстанавливается по номеру хода
+            materializeHistory();
+            Choice choice = *std::exchange(forced_, std::nullopt);
+            recordChoice(choice);
+            return choice;
+        }
+        if (implicitHistory_) {
+            // Хранится только счётчик ходов
+            moveCount_++;
+            return strategy_->makeChoice(kNoHistory, rng);
+        }
+        Choice choice = strategy_->makeChoice(choiceHistory_, rng);
         recordChoice(choice);
         return choice;
     }
     
+    // Восстанавливает историю по номерам ходов и дальше ведёт её явно.
+    // Меняет игрока, поэтому у общего с другой веткой игрока вызывается
+    // только после CowRoster::mutableAt.
+    void materializeHistory() {
+        for (size_t move = choiceHistory_.size(); implicitHistory_ && move < moveCount_; ++move) {
+            choiceHistory_.push_back(strategy_->historyAt(move));
+        }
+        implicitHistory_ = false;
+    }
+    
+    void observeResult(Choice choice, int wins, int losses, int opponents) override {
+        strategy_->observeResult(choice, wins, losses, opponents);
+    }
+    
+    void reserveHistory(size_t moves) override {
+        Player::reserveHistory(moves);
+        strategy_->reserveHistory(moves);
+    }
+    
     std::string getType() const override {
         return "Компьютер (" + strategy_->getName() + ")";
     }
     
+    // Стратегия и хвост истории, куда допишется ход
+    void prefetchState() const override {
+        __builtin_prefetch(strategy_.get());
+        __builtin_prefetch(reinterpret_cast<const char*>(strategy_.get()) + 64);
+        if (!choiceHistory_.empty()) {
+            __builtin_prefetch(choiceHistory_.data() + choiceHistory_.size() - 1, 1);
+        }
+    }
+    
+    std::unique_ptr<Player> clone() const override { return std::make_unique<ComputerPlayer>(*this); }
+    
+    // Стратегия кладётся сразу за игроком
+    Player* relocate(LayoutArena& arena) override {
+        ComputerPlayer* moved = arena.relocate(*this);
+        moved->strategy_ = {moved->strategy_->relocate(arena), LayoutDeleter<ChoiceStrategy>::CURRENT};
+        return moved;
+    }
+    
     bool isHuman() const override { return false; }
 };
 
@@ -327,12 +1474,13 @@ class PlayerFactory {
 private:
     static int humanCounter_;
     static int computerCounter_;
-    static std::mt19937 rng_;
+    static uint32_t nextId_;
     
 public:
     static void resetCounters() {
         humanCounter_ = 0;
         computerCounter_ = 0;
+        nextId_ = 0;
     }
     
     static std::unique_ptr<Player> createHuman(const std::string& name = "") {
@@ -340,30 +1488,42 @@ public:
         std::string playerName = name.empty() 
             ? "Игрок " + std::to_string(humanCounter_) 
             : name;
-        return std::make_unique<HumanPlayer>(playerName);
+        return std::make_unique<HumanPlayer>(nextId_++, playerName);
     }
     
-    static std::unique_ptr<Player> createComputer(const std::string& name = "") {
+    // Стратегия выбирается из потока (seed, раунд 0, игрок),
+    // так что состав ботов воспроизводится по зерну
+    static std::unique_ptr<Player> createComputer(uint64_t seed, const std::string& name = "") {
         computerCounter_++;
+        uint32_t id = nextId_++;
         std::string botName = name.empty() 
             ? "Бот " + std::to_string(computerCounter_) 
             : name;
         
-        std::uniform_int_distribution<int> dist(0, 3);
-        std::unique_ptr<ChoiceStrategy> strategy;
+        CounterRng rng({seed, 0, DrawKey::kService, id, 0});
+        auto strategy = createStrategy(rng.below(kNumStrategies));
         
-        switch (dist(rng_)) {
-            case 0: strategy = std::make_unique<RandomStrategy>(); break;
-            case 1: strategy = std::make_unique<BiasedStrategy>(); break;
-            case 2: strategy = std::make_unique<AdaptiveStrategy>(); break;
-            case 3: strategy = std::make_unique<CyclicStrategy>(); break;
-            default: strategy = std::make_unique<RandomStrategy>(); break;
+        return std::make_unique<ComputerPlayer>(id, botName, std::move(strategy));
+    }
+    
+    static constexpr uint32_t kNumStrategies = 8;
+    
+    static std::unique_ptr<ChoiceStrategy> createStrategy(uint32_t kind) {
+        switch (kind) {
+            case 0: return std::make_unique<RandomStrategy>();
+            case 1: return std::make_unique<BiasedStrategy>();
+            case 2: return std::make_unique<AdaptiveStrategy>();
+            case 3: return std::make_unique<CyclicStrategy>();
+            case 4: return std::make_unique<HistoryMatchStrategy>();
+            case 5: return std::make_unique<MetaStrategy>();
+            case 6: return std::make_unique<Ucb1Strategy>();
+            case 7: return std::make_unique<Exp3Strategy>();
+            default: return std::make_unique<RandomStrategy>();
         }
-        
-        return std::make_unique<ComputerPlayer>(botName, std::move(strategy));
     }
     
-    static std::vector<std::unique_ptr<Player>> createPlayers(int numHumans, int numComputers) {
+    static std::vector<std::unique_ptr<Player>> createPlayers(int numHumans, int numComputers,
+                                                              uint64_t seed) {
         resetCounters();
         std::vector<std::unique_ptr<Player>> players;
         
@@ -381,7 +1541,7 @@ public:
         }
         
         for (int i = 0; i < numComputers; ++i) {
-            players.push_back(createComputer());
+            players.push_back(createComputer(seed));
         }
         
         return players;
@@ -390,7 +1550,7 @@ public:
 
 int PlayerFactory::humanCounter_ = 0;
 int PlayerFactory::computerCounter_ = 0;
-std::mt19937 PlayerFactory::rng_(std::random_device{}());
+uint32_t PlayerFactory::nextId_ = 0;
 
 
 struct PlayerScore {
@@ -402,489 +1562,4591 @@ struct PlayerScore {
     int getNetScore() const { return wins - losses; }
 };
 
+using ScoreList = std::vector<PlayerScore, HugePageAllocator<PlayerScore>>;
 
-class RoundManager {
-protected:
-    std::mt19937 rng_;
-    
+
+// Состав турнира с копированием при записи. Игроки лежат кусками по kChunk
+// указателей, копия состава (Game::fork) копирует только указатели на куски.
+// Перед изменением игрока его кусок и сам игрок копируются, если они общие
+// с другой веткой, так что ветка платит только за тех, кого трогает.
+// Общие объекты ветки на разных потоках только читают.
+class CowRoster {
 public:
-    RoundManager() : rng_(std::random_device{}()) {}
-    virtual ~RoundManager() = default;
+    static constexpr size_t kChunk = 256;
+    using Entry = std::shared_ptr<Player>;
     
-    // Возвращает список проигравших (пустой = ничья, нужна переигровка)
-    std::vector<Player*> executeRound(std::vector<Player*>& players, 
-                                       const std::string& groupName = "") {
-        auto choices = collectChoices(players, groupName);
-        
-        printChoices(choices, groupName);
-        
-        auto scores = calculateScores(choices);
-        
-        printAllComparisons(choices, groupName);
-        
-        printScoreTable(scores, groupName);
-        
-        return determineLosers(scores, groupName);
+    CowRoster() = default;
+    // Пока состав ни разу не копировался, проверки общих объектов не нужны.
+    // Копировать один состав можно с нескольких потоков сразу.
+    CowRoster(const CowRoster& other) : chunks_(other.chunks_), size_(other.size_), shared_(true) {
+        other.shared_.store(true, std::memory_order_relaxed);
+    }
+    CowRoster& operator=(const CowRoster& other) {
+        chunks_ = other.chunks_;
+        size_ = other.size_;
+        other.shared_.store(true, std::memory_order_relaxed);
+        shared_.store(true, std::memory_order_relaxed);
+        return *this;
+    }
+    CowRoster(CowRoster&& other) noexcept
+        : chunks_(std::move(other.chunks_)), size_(other.size_),
+          shared_(other.shared_.load(std::memory_order_relaxed)) {}
+    CowRoster& operator=(CowRoster&& other) noexcept {
+        chunks_ = std::move(other.chunks_);
+        size_ = other.size_;
+        shared_.store(other.shared_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
     }
     
-protected:
-    std::vector<std::pair<Player*, Choice>> collectChoices(
-            std::vector<Player*>& players, const std::string& groupName) {
-        
-        if (!groupName.empty()) {
-            std::cout << "\n  [" << groupName << "] Игроки делают выбор...\n";
-        }
-        
-        std::vector<std::pair<Player*, Choice>> choices;
-        
-        // Сначала люди
-        std::vector<std::pair<Player*, Choice>> humanChoices;
-        for (auto* player : players) {
-            if (player->isHuman()) {
-                Choice choice = player->makeChoice();
-                humanChoices.push_back({player, choice});
+    void assign(std::vector<std::unique_ptr<Player>> players) {
+        chunks_.clear();
+        size_ = players.size();
+        shared_.store(false, std::memory_order_relaxed);
+        for (size_t begin = 0; begin < players.size(); begin += kChunk) {
+            auto chunk = std::make_shared<Chunk>();
+            for (size_t i = begin; i < std::min(players.size(), begin + kChunk); ++i) {
+                chunk->push_back(Entry(players[i].release(), LayoutDeleter<Player>{}));
             }
+            chunks_.push_back(std::move(chunk));
         }
-        
-        // Затем компьютеры
-        for (auto* player : players) {
-            if (!player->isHuman()) {
-                Choice choice = player->makeChoice();
-                choices.push_back({player, choice});
-            }
+    }
+    
+    size_t size() const { return size_; }
+    const Player& operator[](size_t slot) const { return *(*chunks_[slot / kChunk])[slot % kChunk]; }
+    
+    // Игрок, которого можно менять: копирует общий кусок и общего игрока
+    Player* mutableAt(size_t slot) {
+        return detach(slot).get();
+    }
+    
+    // Место игрока для замены объекта (--group-layout); состав не должен быть общим
+    Entry& entry(size_t slot) { return detach(slot); }
+    
+    // Сколько игроков скопировано при записи за всё время
+    static size_t clones() { return clones_.load(std::memory_order_relaxed); }
+    
+private:
+    using Chunk = std::vector<Entry>;
+    
+    std::vector<std::shared_ptr<Chunk>> chunks_;
+    size_t size_ = 0;
+    mutable std::atomic<bool> shared_{false};
+    static inline std::atomic<size_t> clones_{0};
+    
+    // use_count() == 1 читается без упорядочения; барьер acquire
+    // синхронизируется с освобождением ссылки в другой ветке, после
+    // которого объект наш и его можно менять
+    template <typename T>
+    static bool unique(const std::shared_ptr<T>& ptr) {
+        if (ptr.use_count() != 1) {
+            return false;
         }
-        
-        for (auto& hc : humanChoices) {
-            choices.push_back(hc);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+    
+    Entry& detach(size_t slot) {
+        auto& chunk = chunks_[slot / kChunk];
+        if (!shared_.load(std::memory_order_relaxed)) {
+            return (*chunk)[slot % kChunk];
         }
-        
-        return choices;
+        if (!unique(chunk)) {
+            chunk = std::make_shared<Chunk>(*chunk);
+        }
+        Entry& player = (*chunk)[slot % kChunk];
+        if (!unique(player)) {
+            player = Entry(player->clone().release(), LayoutDeleter<Player>{});
+            clones_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return player;
     }
+};
+
+
+// Группа, разбитая один раз при формировании: люди в [0, numHumans),
+// боты в [numHumans, size). Порядок внутри частей сохраняется.
+struct Group {
+    std::vector<Player*> players;
+    size_t numHumans = 0;
     
-    std::vector<PlayerScore> calculateScores(
-            const std::vector<std::pair<Player*, Choice>>& choices) {
-        
-        std::vector<PlayerScore> scores;
-        for (const auto& [player, choice] : choices) {
-            scores.push_back({player, choice, 0, 0});
+    Group() = default;
+    explicit Group(const std::vector<Player*>& members) {
+        assign(members.data(), members.data() + members.size());
+    }
+    
+    // Перезаполняет группу, сохраняя ёмкость: люди вперёд, порядок внутри
+    // людей и ботов прежний (без временного буфера stable_partition)
+    void assign(Player* const* first, Player* const* last) {
+        players.clear();
+        for (Player* const* p = first; p != last; ++p) {
+            if ((*p)->isHuman()) {
+                players.push_back(*p);
+            }
         }
-        
-        for (size_t i = 0; i < scores.size(); ++i) {
-            for (size_t j = i + 1; j < scores.size(); ++j) {
-                DuelResult result = GameRules::compare(scores[i].choice, scores[j].choice);
-                
-                switch (result) {
-                    case DuelResult::WIN:
-                        scores[i].wins++;
-                        scores[j].losses++;
-                        break;
-                    case DuelResult::LOSE:
-                        scores[i].losses++;
-                        scores[j].wins++;
-                        break;
-                    case DuelResult::DRAW:
-                        break;
-                }
+        numHumans = players.size();
+        for (Player* const* p = first; p != last; ++p) {
+            if (!(*p)->isHuman()) {
+                players.push_back(*p);
             }
         }
-        
-        return scores;
     }
     
-    void printChoices(const std::vector<std::pair<Player*, Choice>>& choices,
-                      const std::string& groupName) {
-        if (!groupName.empty()) {
+    size_t size() const { return players.size(); }
+    size_t numBots() const { return players.size() - numHumans; }
+    bool hasHumans() const { return numHumans > 0; }
+    
+    Player* const* humans() const { return players.data(); }
+    Player* const* bots() const { return players.data() + numHumans; }
+    
+    // Убирает выбывших, не нарушая разбиения
+    void removeInactive() {
+        auto inactive = [](const Player* p) { return !p->isActive(); };
+        numHumans -= static_cast<size_t>(
+            std::count_if(players.begin(), players.begin() + numHumans, inactive));
+        players.erase(std::remove_if(players.begin(), players.end(), inactive), players.end());
+    }
+};
+
+
+// Правило выбывания в группе. Классическое - выбывают все с минимальным
+// балансом; остальные задают желаемое число выживших, чтобы турнир
+// сходился за O(log n) раундов.
+struct EliminationPolicy {
+    enum class Kind {
+        MIN_SCORE,       // min                - все с худшим балансом
+        BOTTOM_FRACTION, // bottom:F           - выбывает доля F (не меньше одного)
+        KEEP_TOP,        // top:K              - остаются K лучших
+        SURVIVOR_RATIO   // ratio:R            - остаётся доля R (не меньше одного)
+    };
+    
+    Kind kind = Kind::MIN_SCORE;
+    double fraction = 0.0;
+    size_t keep = 0;
+    
+    // Желаемое число выживших из n (1..n-1), для MIN_SCORE не используется
+    size_t targetSurvivors(size_t n) const {
+        size_t survivors = n - 1;
+        switch (kind) {
+            case Kind::MIN_SCORE:
+                break;
+            case Kind::BOTTOM_FRACTION:
+                survivors = n - std::max<size_t>(1, static_cast<size_t>(n * fraction));
+                break;
+            case Kind::KEEP_TOP:
+                survivors = keep;
+                break;
+            case Kind::SURVIVOR_RATIO:
+                survivors = static_cast<size_t>(std::ceil(n * fraction));
+                break;
+        }
+        return std::clamp<size_t>(survivors, 1, n - 1);
+    }
+    
+    static EliminationPolicy parse(const std::string& spec) {
+        EliminationPolicy policy;
+        size_t colon = spec.find(':');
+        std::string name = spec.substr(0, colon);
+        std::string value = colon == std::string::npos ? "" : spec.substr(colon + 1);
+        
+        if (name == "min" && value.empty()) {
+            return policy;
+        }
+        // Число должно быть разобрано целиком: stod принимает "0.5abc",
+        // а stoul молча заворачивает "-1" в 2^64-1
+        size_t used = 0;
+        if (name == "bottom" || name == "ratio") {
+            policy.kind = name == "bottom" ? Kind::BOTTOM_FRACTION : Kind::SURVIVOR_RATIO;
+            policy.fraction = std::stod(value, &used);
+            if (used == value.size() && policy.fraction > 0.0 && policy.fraction < 1.0) {
+                return policy;
+            }
+        } else if (name == "top") {
+            policy.kind = Kind::KEEP_TOP;
+            long long keep = std::stoll(value, &used);
+            if (used == value.size() && keep > 0) {
+                policy.keep = static_cast<size_t>(keep);
+                return policy;
+            }
+        }
+        throw std::invalid_argument("неверное правило выбывания " + spec);
+    }
+    
+    std::string describe() const {
+        switch (kind) {
+            case Kind::BOTTOM_FRACTION:
+                return "выбывает " + std::to_string(static_cast<int>(fraction * 100)) + "% худших";
+            case Kind::KEEP_TOP:
+                return "остаются " + std::to_string(keep) + " лучших";
+            case Kind::SURVIVOR_RATIO:
+                return "остаётся " + std::to_string(static_cast<int>(fraction * 100)) + "% лучших";
+            case Kind::MIN_SCORE:
+                break;
+        }
+        return "выбывают все с худшим балансом";
+    }
+};
+
+
+// Счётчики работы движка для --metrics. Каждый поток считает в свой слот
+// (своя кэш-линия, запись relaxed без конкуренции), сумма собирается только
+// при запросе. Слот завершившегося потока сливается в общий итог и
+// освобождается, так что короткие потоки std::async не копят слоты.
+// Выключенные метрики стоят одной проверки флага.
+class Metrics {
+public:
+    enum Counter {
+        ROUNDS, ATTEMPTS, REPLAYS, DUELS, BOT_MOVES, EXPORT_BYTES, TOURNAMENTS, kCounters
+    };
+    enum Gauge { ACTIVE_PLAYERS, WRITER_QUEUE, kGauges };
+    
+    static bool enabled() { return enabled_; }
+    
+    // Включается до запуска рабочих потоков
+    static void enable() {
+        start_ = std::chrono::steady_clock::now();
+        enabled_ = true;
+    }
+    
+    static void add(Counter counter, uint64_t n = 1) {
+        if (enabled()) {
+            auto& value = slot().values[counter];
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    }
+    
+    static void set(Gauge gauge, int64_t value) {
+        if (enabled()) {
+            gauges_[gauge].store(value, std::memory_order_relaxed);
+        }
+    }
+    
+    static void adjust(Gauge gauge, int64_t delta) {
+        if (enabled()) {
+            gauges_[gauge].fetch_add(delta, std::memory_order_relaxed);
+        }
+    }
+    
+    // Текстовый формат Prometheus 0.0.4
+    static std::string render() {
+        std::array<uint64_t, kCounters> totals{};
+        {
+            std::lock_guard<std::mutex> lock(registryMutex_);
+            totals = retired_;
+            for (const auto& s : slots_) {
+                for (size_t c = 0; c < kCounters; ++c) {
+                    totals[c] += s->values[c].load(std::memory_order_relaxed);
+                }
+            }
+        }
+        
+        std::ostringstream out;
+        for (size_t c = 0; c < kCounters; ++c) {
+            out << "# HELP rpsls_" << kCounterInfo[c].name << "_total " << kCounterInfo[c].help << "\n"
+                << "# TYPE rpsls_" << kCounterInfo[c].name << "_total counter\n"
+                << "rpsls_" << kCounterInfo[c].name << "_total " << totals[c] << "\n";
+        }
+        for (size_t g = 0; g < kGauges; ++g) {
+            out << "# HELP rpsls_" << kGaugeInfo[g].name << " " << kGaugeInfo[g].help << "\n"
+                << "# TYPE rpsls_" << kGaugeInfo[g].name << " gauge\n"
+                << "rpsls_" << kGaugeInfo[g].name << " "
+                << gauges_[g].load(std::memory_order_relaxed) << "\n";
+        }
+        out << "# HELP rpsls_uptime_seconds Seconds since metrics were enabled.\n"
+            << "# TYPE rpsls_uptime_seconds gauge\n"
+            << "rpsls_uptime_seconds " << std::fixed << std::setprecision(3)
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count() << "\n";
+        return out.str();
+    }
+    
+private:
+    struct Info {
+        const char* name;
+        const char* help;
+    };
+    
+    static constexpr Info kCounterInfo[kCounters] = {
+        {"rounds", "Completed tournament rounds."},
+        {"attempts", "Group round attempts, replays included."},
+        {"replays", "Attempts replayed because nobody lost."},
+        {"duels", "Pairwise duels decided (n*(n-1)/2 per attempt)."},
+        {"bot_moves", "Moves made by computer players."},
+        {"export_bytes", "Bytes written to the history export."},
+        {"tournaments", "Headless tournaments played by --evolve."}
+    };
+    static constexpr Info kGaugeInfo[kGauges] = {
+        {"active_players", "Players still in the current tournament."},
+        {"writer_queue", "Export buffers submitted and not yet written."}
+    };
+    
+    struct alignas(64) Slot {
+        std::array<std::atomic<uint64_t>, kCounters> values{};
+    };
+    
+    // Слот потока; при выходе потока его счёт уходит в retired_
+    struct SlotOwner {
+        Slot* slot = nullptr;
+        
+        ~SlotOwner() {
+            if (slot) {
+                retire(slot);
+            }
+        }
+    };
+    
+    static inline bool enabled_ = false;
+    static inline std::chrono::steady_clock::time_point start_;
+    static inline std::array<std::atomic<int64_t>, kGauges> gauges_{};
+    static inline std::mutex registryMutex_;
+    static inline std::vector<std::unique_ptr<Slot>> slots_;
+    static inline std::array<uint64_t, kCounters> retired_{};
+    
+    static Slot& slot() {
+        thread_local SlotOwner owner;
+        if (!owner.slot) {
+            std::lock_guard<std::mutex> lock(registryMutex_);
+            slots_.push_back(std::make_unique<Slot>());
+            owner.slot = slots_.back().get();
+        }
+        return *owner.slot;
+    }
+    
+    static void retire(Slot* slot) {
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        for (size_t c = 0; c < kCounters; ++c) {
+            retired_[c] += slot->values[c].load(std::memory_order_relaxed);
+        }
+        auto it = std::find_if(slots_.begin(), slots_.end(),
+                               [slot](const std::unique_ptr<Slot>& s) { return s.get() == slot; });
+        if (it != slots_.end()) {
+            std::swap(*it, slots_.back());
+            slots_.pop_back();
+        }
+    }
+};
+
+// HTTP-отдача метрик на локальном адресе: "PORT" (127.0.0.1:PORT, 0 - любой
+// свободный) или "unix:/путь". Один фоновый поток, запросы обслуживаются по очереди -
+// для скрейпа раз в несколько секунд этого достаточно.
+class MetricsServer {
+public:
+    explicit MetricsServer(const std::string& address) {
+        if (address.rfind("unix:", 0) == 0) {
+            std::string path = address.substr(5);
+            sockaddr_un local{};
+            if (path.empty() || path.size() >= sizeof(local.sun_path)) {
+                throw std::invalid_argument("неверный путь сокета метрик " + path);
+            }
+            local.sun_family = AF_UNIX;
+            std::memcpy(local.sun_path, path.c_str(), path.size() + 1);
+            // Старый сокет от прошлого запуска убираем, любой другой файл - нет
+            struct stat existing{};
+            if (::lstat(path.c_str(), &existing) == 0) {
+                if (!S_ISSOCK(existing.st_mode)) {
+                    throw std::invalid_argument("путь метрик занят, это не сокет: " + path);
+                }
+                ::unlink(path.c_str());
+            }
+            listen(AF_UNIX, reinterpret_cast<sockaddr*>(&local), sizeof(local), address);
+            unixPath_ = path;
+        } else {
+            unsigned long port = std::stoul(address);
+            if (port > 65535) {
+                throw std::invalid_argument("неверный порт метрик " + address);
+            }
+            sockaddr_in local{};
+            local.sin_family = AF_INET;
+            local.sin_port = htons(static_cast<uint16_t>(port));
+            local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            listen(AF_INET, reinterpret_cast<sockaddr*>(&local), sizeof(local), address);
+        }
+        thread_ = std::thread([this]() { serve(); });
+    }
+    
+    ~MetricsServer() {
+        stop_ = true;
+        thread_.join();
+        ::close(listenFd_);
+        if (!unixPath_.empty()) {
+            ::unlink(unixPath_.c_str());
+        }
+    }
+    
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+    
+    // Фактический TCP-порт (после "0"), для unix-сокета 0
+    uint16_t port() const {
+        sockaddr_in bound{};
+        socklen_t length = sizeof(bound);
+        if (!unixPath_.empty() ||
+            ::getsockname(listenFd_, reinterpret_cast<sockaddr*>(&bound), &length) < 0) {
+            return 0;
+        }
+        return ntohs(bound.sin_port);
+    }
+    
+private:
+    static constexpr int kPollMs = 200;
+    static constexpr size_t kMaxRequest = 8192;
+    
+    int listenFd_ = -1;
+    std::string unixPath_;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+    
+    void listen(int family, const sockaddr* address, socklen_t length, const std::string& name) {
+        listenFd_ = ::socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        if (listenFd_ < 0 ||
+            (family == AF_INET &&
+             ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) ||
+            ::bind(listenFd_, address, length) < 0 || ::listen(listenFd_, 16) < 0) {
+            std::string error = std::strerror(errno);
+            if (listenFd_ >= 0) {
+                ::close(listenFd_);
+            }
+            throw std::runtime_error("не удалось открыть метрики на " + name + ": " + error);
+        }
+    }
+    
+    void serve() {
+        while (!stop_) {
+            pollfd waiting{listenFd_, POLLIN, 0};
+            if (::poll(&waiting, 1, kPollMs) <= 0) {
+                continue;
+            }
+            int client = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0) {
+                respond(client);
+                ::close(client);
+            }
+        }
+    }
+    
+    // Читает заголовок запроса (с таймаутом, чтобы молчащий клиент не
+    // держал поток) и отвечает на GET /metrics
+    void respond(int client) {
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequest) {
+            pollfd readable{client, POLLIN, 0};
+            if (::poll(&readable, 1, kPollMs) <= 0) {
+                return;
+            }
+            ssize_t n = ::recv(client, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                return;
+            }
+            request.append(buffer, static_cast<size_t>(n));
+        }
+        
+        bool metrics = request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET / ", 0) == 0;
+        std::string body = metrics ? Metrics::render() : "not found\n";
+        std::string response = std::string(metrics ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n")
+            + "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            + "Connection: close\r\n\r\n" + body;
+        
+        size_t sent = 0;
+        while (sent < response.size()) {
+            ssize_t n = ::send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return;
+            }
+            sent += static_cast<size_t>(n);
+        }
+    }
+};
+
+// Проверка --check-metrics: сервер поднимается на свободном TCP-порту и на
+// unix-сокете во временном каталоге, локальный клиент делает GET /metrics
+// и сверяет строку статуса и счётчик. Часть счёта приходит из уже
+// завершившегося потока, а занятый обычным файлом путь сокета должен
+// остаться нетронутым.
+class MetricsCheck {
+public:
+    static bool run() {
+        constexpr uint64_t kExited = 40;
+        constexpr uint64_t kMain = 2;
+        Metrics::enable();
+        std::thread([]() { Metrics::add(Metrics::REPLAYS, kExited); }).join();
+        Metrics::add(Metrics::REPLAYS, kMain);
+        std::string expected = "\nrpsls_replays_total " + std::to_string(kExited + kMain) + "\n";
+        
+        char dirTemplate[] = "/tmp/rpsls-metrics-XXXXXX";
+        if (!::mkdtemp(dirTemplate)) {
+            std::cout << "  ОШИБКА: не удалось создать каталог: " << std::strerror(errno) << "\n";
+            return false;
+        }
+        std::string dir = dirTemplate;
+        std::string socketPath = dir + "/metrics.sock";
+        std::string filePath = dir + "/occupied";
+        bool ok = true;
+        
+        try {
+            MetricsServer server("0");
+            sockaddr_in remote{};
+            remote.sin_family = AF_INET;
+            remote.sin_port = htons(server.port());
+            remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            ok = check("127.0.0.1:" + std::to_string(server.port()),
+                       fetch(AF_INET, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)),
+                       expected) && ok;
+        } catch (const std::exception& e) {
+            std::cout << "    TCP: " << e.what() << "\n";
+            ok = false;
+        }
+        
+        try {
+            MetricsServer server("unix:" + socketPath);
+            sockaddr_un remote{};
+            remote.sun_family = AF_UNIX;
+            std::memcpy(remote.sun_path, socketPath.c_str(), socketPath.size() + 1);
+            ok = check("unix:" + socketPath,
+                       fetch(AF_UNIX, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)),
+                       expected) && ok;
+        } catch (const std::exception& e) {
+            std::cout << "    unix: " << e.what() << "\n";
+            ok = false;
+        }
+        
+        std::ofstream(filePath) << "keep\n";
+        bool refused = false;
+        try {
+            MetricsServer server("unix:" + filePath);
+        } catch (const std::invalid_argument&) {
+            refused = true;
+        }
+        bool kept = ::access(filePath.c_str(), F_OK) == 0;
+        std::cout << "    Обычный файл на месте сокета: " << (refused ? "отказ" : "принят")
+                  << ", файл " << (kept ? "цел" : "удалён") << "\n";
+        ok = ok && refused && kept;
+        
+        ::unlink(filePath.c_str());
+        ::unlink(socketPath.c_str());
+        ::rmdir(dir.c_str());
+        
+        std::cout << (ok ? "  OK\n" : "  ОШИБКА: метрики отдаются неверно\n");
+        return ok;
+    }
+    
+private:
+    static constexpr int kTimeoutSeconds = 2;
+    
+    // Весь ответ: сервер закрывает соединение после него
+    static std::string fetch(int family, const sockaddr* address, socklen_t length) {
+        int fd = ::socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+        timeval timeout{kTimeoutSeconds, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        
+        std::string response;
+        const std::string request = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        if (::connect(fd, address, length) == 0 &&
+            ::send(fd, request.data(), request.size(), MSG_NOSIGNAL) ==
+                static_cast<ssize_t>(request.size())) {
+            char buffer[4096];
+            ssize_t n;
+            while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+                response.append(buffer, static_cast<size_t>(n));
+            }
+        }
+        ::close(fd);
+        return response;
+    }
+    
+    static bool check(const std::string& name, const std::string& response,
+                      const std::string& expected) {
+        bool status = response.rfind("HTTP/1.1 200 OK\r\n", 0) == 0;
+        bool counter = response.find(expected) != std::string::npos;
+        std::cout << "    " << name << ": " << (status ? "200 OK" : "нет ответа 200")
+                  << ", счётчик " << (counter ? "сходится" : "не сходится") << "\n";
+        return status && counter;
+    }
+};
+
+
+// Трассировка в формате Chrome trace (chrome://tracing, ui.perfetto.dev).
+// Каждый поток пишет события в свой буфер без блокировок; мьютекс берётся
+// только при первой записи потока. Выключенная трассировка стоит одной
+// проверки флага, а с -DRPSLS_NO_TRACE вырезается компилятором.
+class Trace {
+public:
+    static constexpr int64_t kNoArg = -1;
+    
+#ifdef RPSLS_NO_TRACE
+    static constexpr bool enabled() { return false; }
+#else
+    static bool enabled() { return enabled_; }
+#endif
+    
+    // Включается до запуска рабочих потоков
+    static void start() {
+#ifdef RPSLS_NO_TRACE
+        throw std::invalid_argument("сборка без трассировки (RPSLS_NO_TRACE)");
+#else
+        origin_ = std::chrono::steady_clock::now();
+        enabled_ = true;
+        buffer();
+#endif
+    }
+    
+    // Интервал от создания до разрушения объекта
+    class Span {
+    public:
+        Span(const char* name, int64_t arg = kNoArg) {
+            if (enabled()) {
+                name_ = name;
+                arg_ = arg;
+                start_ = now();
+            }
+        }
+        ~Span() {
+            if (name_) {
+                buffer().events.push_back({name_, start_, now() - start_, arg_});
+            }
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+        
+    private:
+        const char* name_ = nullptr;
+        int64_t arg_ = kNoArg;
+        uint64_t start_ = 0;
+    };
+    
+    static void write(const std::string& path) {
+        std::ofstream out(path);
+        if (!out) {
+            throw std::runtime_error("не удалось открыть " + path);
+        }
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (const auto& thread : threads_) {
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << thread->tid << ",\"args\":{\"name\":\""
+                << (thread->tid == 0 ? std::string("движок") : "поток " + std::to_string(thread->tid))
+                << "\"}}";
+            first = false;
+            for (const auto& event : thread->events) {
+                out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                    << thread->tid << ",\"ts\":" << event.start / 1000 << '.'
+                    << std::setw(3) << std::setfill('0') << event.start % 1000
+                    << ",\"dur\":" << std::setfill(' ') << event.duration / 1000 << '.'
+                    << std::setw(3) << std::setfill('0') << event.duration % 1000 << std::setfill(' ');
+                if (event.arg != kNoArg) {
+                    out << ",\"args\":{\"n\":" << event.arg << "}";
+                }
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+    }
+    
+private:
+    struct Event {
+        const char* name;   // строковый литерал
+        uint64_t start;     // нс от start()
+        uint64_t duration;
+        int64_t arg;
+    };
+    
+    struct ThreadBuffer {
+        uint32_t tid;
+        std::vector<Event> events;
+    };
+    
+    static inline bool enabled_ = false;
+    static inline std::chrono::steady_clock::time_point origin_;
+    static inline std::mutex registryMutex_;
+    // Буферы переживают свои потоки: потоки std::async короткоживущие
+    static inline std::vector<std::unique_ptr<ThreadBuffer>> threads_;
+    
+    static uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - origin_).count());
+    }
+    
+    static ThreadBuffer& buffer() {
+        thread_local ThreadBuffer* local = nullptr;
+        if (!local) {
+            std::lock_guard<std::mutex> lock(registryMutex_);
+            threads_.push_back(std::make_unique<ThreadBuffer>());
+            threads_.back()->tid = static_cast<uint32_t>(threads_.size() - 1);
+            local = threads_.back().get();
+        }
+        return *local;
+    }
+};
+
+
+// Асинхронная дозапись файла для экспорта: данные копируются в один из
+// kBuffers буферов по kBufferSize, полный буфер уходит на запись, и цикл
+// раундов ждёт только тогда, когда заняты все буферы. Бэкенды - io_uring
+// (зарегистрированные буферы, пакетная отправка) и пул потоков с pwrite.
+class AsyncFileWriter {
+public:
+    enum class Backend { AUTO, URING, PWRITE };
+    
+    static constexpr size_t kBufferSize = 1 << 20;
+    static constexpr size_t kBuffers = 8;
+    
+    // AUTO - io_uring, если ядро и лимиты позволяют, иначе pwrite
+    static std::unique_ptr<AsyncFileWriter> open(const std::string& path, Backend backend,
+                                                 unsigned threads);
+    
+    static Backend parseBackend(const std::string& name) {
+        if (name == "auto") return Backend::AUTO;
+        if (name == "uring") return Backend::URING;
+        if (name == "pwrite") return Backend::PWRITE;
+        throw std::invalid_argument("неизвестный бэкенд записи " + name);
+    }
+    
+    virtual ~AsyncFileWriter() {
+        ::close(fd_);
+    }
+    
+    void append(const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        while (size > 0) {
+            if (current_ == kNoBuffer) {
+                current_ = acquire();
+                filled_ = 0;
+            }
+            size_t part = std::min(size, kBufferSize - filled_);
+            std::memcpy(buffer(current_) + filled_, bytes, part);
+            filled_ += part;
+            bytes += part;
+            size -= part;
+            if (filled_ == kBufferSize) {
+                dispatch();
+            }
+        }
+    }
+    
+    // Дописывает остаток и ждёт завершения всех записей
+    void finish() {
+        if (current_ != kNoBuffer && filled_ > 0) {
+            dispatch();
+        }
+        drain();
+        if (!error_.empty()) {
+            throw std::runtime_error("ошибка записи экспорта: " + error_);
+        }
+    }
+    
+    virtual const char* backendName() const = 0;
+    
+protected:
+    static constexpr size_t kNoBuffer = std::numeric_limits<size_t>::max();
+    
+    int fd_;
+    std::unique_ptr<uint8_t[]> memory_;
+    std::string error_;
+    
+    explicit AsyncFileWriter(int fd)
+        : fd_(fd), memory_(std::make_unique<uint8_t[]>(kBuffers * kBufferSize)) {}
+    
+    uint8_t* buffer(size_t index) { return memory_.get() + index * kBufferSize; }
+    
+    // Свободный буфер; ждёт завершения записи, если свободных нет
+    virtual size_t acquire() = 0;
+    // Запись буфера index (size байт) по смещению offset
+    virtual void submit(size_t index, size_t size, uint64_t offset) = 0;
+    // Дождаться всех отправленных записей
+    virtual void drain() = 0;
+    
+private:
+    size_t current_ = kNoBuffer;
+    size_t filled_ = 0;
+    uint64_t offset_ = 0;
+    
+    void dispatch() {
+        Metrics::adjust(Metrics::WRITER_QUEUE, 1);
+        submit(current_, filled_, offset_);
+        offset_ += filled_;
+        current_ = kNoBuffer;
+    }
+};
+
+// Запасной бэкенд: потоки пула пишут буферы pwrite по своим смещениям
+class PwriteFileWriter : public AsyncFileWriter {
+public:
+    PwriteFileWriter(int fd, unsigned threads) : AsyncFileWriter(fd) {
+        for (size_t i = 0; i < kBuffers; ++i) {
+            free_.push_back(i);
+        }
+        for (unsigned t = 0; t < std::clamp<unsigned>(threads, 1, kBuffers); ++t) {
+            workers_.emplace_back([this]() { work(); });
+        }
+    }
+    
+    ~PwriteFileWriter() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+    
+    const char* backendName() const override { return "pwrite"; }
+    
+protected:
+    size_t acquire() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return !free_.empty(); });
+        size_t index = free_.back();
+        free_.pop_back();
+        return index;
+    }
+    
+    void submit(size_t index, size_t size, uint64_t offset) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back({index, size, offset});
+        }
+        wake_.notify_one();
+    }
+    
+    void drain() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return free_.size() == kBuffers; });
+    }
+    
+private:
+    struct Job {
+        size_t index;
+        size_t size;
+        uint64_t offset;
+    };
+    
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::deque<Job> jobs_;
+    std::vector<size_t> free_;
+    std::vector<std::thread> workers_;
+    bool stopping_ = false;
+    
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+            if (jobs_.empty()) {
+                return;
+            }
+            Job job = jobs_.front();
+            jobs_.pop_front();
+            lock.unlock();
+            
+            Trace::Span span("pwrite", static_cast<int64_t>(job.size));
+            std::string error;
+            const uint8_t* data = buffer(job.index);
+            size_t written = 0;
+            while (written < job.size) {
+                ssize_t n = ::pwrite(fd_, data + written, job.size - written,
+                                     static_cast<off_t>(job.offset + written));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    error = n < 0 ? std::strerror(errno) : "запись не продвигается";
+                    break;
+                }
+                written += static_cast<size_t>(n);
+            }
+            
+            lock.lock();
+            if (!error.empty() && error_.empty()) {
+                error_ = error;
+            }
+            free_.push_back(job.index);
+            Metrics::adjust(Metrics::WRITER_QUEUE, -1);
+            done_.notify_all();
+        }
+    }
+};
+
+#ifdef RPSLS_HAVE_IO_URING
+// io_uring через системные вызовы, без liburing. Буферы регистрируются
+// один раз (IORING_OP_WRITE_FIXED не отображает страницы на каждую запись),
+// заявки копятся и отправляются пачками по kSubmitBatch одним io_uring_enter.
+class UringFileWriter : public AsyncFileWriter {
+public:
+    static constexpr unsigned kSubmitBatch = 2;
+    
+    // nullptr, если io_uring недоступен (старое ядро, seccomp, RLIMIT_MEMLOCK)
+    static std::unique_ptr<UringFileWriter> create(int fd) {
+        std::unique_ptr<UringFileWriter> writer(new UringFileWriter(fd));
+        return writer->ready_ ? std::move(writer) : nullptr;
+    }
+    
+    ~UringFileWriter() override {
+        if (ready_) {
+            try {
+                drain();
+            } catch (const std::exception&) {
+            }
+        }
+        if (sqes_ != MAP_FAILED) ::munmap(sqes_, sqesSize_);
+        if (cqRing_ != MAP_FAILED) ::munmap(cqRing_, cqSize_);
+        if (sqRing_ != MAP_FAILED) ::munmap(sqRing_, sqSize_);
+        if (ring_ >= 0) ::close(ring_);
+    }
+    
+    const char* backendName() const override { return "io_uring"; }
+    
+protected:
+    size_t acquire() override {
+        reap();
+        while (free_.empty()) {
+            enter(1);
+            reap();
+        }
+        size_t index = free_.back();
+        free_.pop_back();
+        return index;
+    }
+    
+    void submit(size_t index, size_t size, uint64_t offset) override {
+        unsigned tail = *sqTail_;
+        io_uring_sqe& sqe = sqes_[tail & *sqMask_];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITE_FIXED;
+        sqe.fd = fd_;
+        sqe.addr = reinterpret_cast<uint64_t>(buffer(index));
+        sqe.len = static_cast<uint32_t>(size);
+        sqe.off = offset;
+        sqe.buf_index = static_cast<uint16_t>(index);
+        sqe.user_data = index;
+        sizes_[index] = size;
+        sqArray_[tail & *sqMask_] = tail & *sqMask_;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        
+        if (++unsubmitted_ >= kSubmitBatch) {
+            enter(0);
+        }
+    }
+    
+    void drain() override {
+        reap();
+        while (free_.size() < kBuffers) {
+            enter(1);
+            reap();
+        }
+    }
+    
+private:
+    int ring_ = -1;
+    bool ready_ = false;
+    void* sqRing_ = MAP_FAILED;
+    void* cqRing_ = MAP_FAILED;
+    io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqSize_ = 0;
+    size_t cqSize_ = 0;
+    size_t sqesSize_ = 0;
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqMask_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned* cqMask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned unsubmitted_ = 0;
+    std::vector<size_t> free_;
+    std::array<size_t, kBuffers> sizes_{};
+    
+    explicit UringFileWriter(int fd) : AsyncFileWriter(fd) {
+        io_uring_params params{};
+        ring_ = static_cast<int>(::syscall(__NR_io_uring_setup, kBuffers, &params));
+        if (ring_ < 0) {
+            return;
+        }
+        
+        sqSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqRing_ = ::mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring_, IORING_OFF_SQ_RING);
+        cqRing_ = ::mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring_, IORING_OFF_CQ_RING);
+        sqes_ = static_cast<io_uring_sqe*>(::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                                                  MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQES));
+        if (sqRing_ == MAP_FAILED || cqRing_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+            return;
+        }
+        
+        auto* sq = static_cast<char*>(sqRing_);
+        auto* cq = static_cast<char*>(cqRing_);
+        sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        
+        std::array<iovec, kBuffers> iovecs;
+        for (size_t i = 0; i < kBuffers; ++i) {
+            iovecs[i] = {buffer(i), kBufferSize};
+            free_.push_back(i);
+        }
+        if (::syscall(__NR_io_uring_register, ring_, IORING_REGISTER_BUFFERS,
+                      iovecs.data(), kBuffers) < 0) {
+            return;
+        }
+        ready_ = true;
+    }
+    
+    // Отправить накопленные заявки и, если wait, дождаться хотя бы одной
+    void enter(unsigned wait) {
+        Trace::Span span(wait ? "io_uring ожидание" : "io_uring отправка", unsubmitted_);
+        while (true) {
+            long n = ::syscall(__NR_io_uring_enter, ring_, unsubmitted_, wait,
+                               wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (n >= 0) {
+                unsubmitted_ -= static_cast<unsigned>(n);
+                return;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw std::runtime_error(std::string("io_uring_enter: ") + std::strerror(errno));
+            }
+        }
+    }
+    
+    void reap() {
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & *cqMask_];
+            size_t index = static_cast<size_t>(cqe.user_data);
+            if (cqe.res < 0 && error_.empty()) {
+                error_ = std::strerror(-cqe.res);
+            } else if (static_cast<size_t>(cqe.res) != sizes_[index] && error_.empty()) {
+                error_ = "короткая запись";
+            }
+            free_.push_back(index);
+            Metrics::adjust(Metrics::WRITER_QUEUE, -1);
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    }
+};
+#endif
+
+std::unique_ptr<AsyncFileWriter> AsyncFileWriter::open(const std::string& path, Backend backend,
+                                                       unsigned threads) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("не удалось открыть " + path + ": " + std::strerror(errno));
+    }
+#ifdef RPSLS_HAVE_IO_URING
+    if (backend != Backend::PWRITE) {
+        int ringFd = ::dup(fd);
+        if (auto writer = UringFileWriter::create(ringFd)) {
+            ::close(fd);
+            return writer;
+        }
+        if (backend == Backend::URING) {
+            ::close(fd);
+            throw std::runtime_error("io_uring недоступен");
+        }
+    }
+#else
+    if (backend == Backend::URING) {
+        ::close(fd);
+        throw std::runtime_error("сборка без io_uring");
+    }
+#endif
+    return std::make_unique<PwriteFileWriter>(fd, threads);
+}
+
+
+// Кодирование столбцов экспорта истории: varint, RLE, упаковка битов
+// и энтропийное кодирование выборов (rANS)
+struct ColumnCodec {
+    enum Encoding : uint8_t {
+        RLE = 0,         // пары (значение, длина серии) в varint
+        BIT_PACKED = 1,  // байт ширины w, затем значения по w бит, младшие первыми
+        RANS = 2         // выборы: частоты по контексту, kRansStates x u32, поток rANS
+    };
+    
+    // rANS (Duda): вероятности в 1/1024, состояние в [2^16, 2^32),
+    // нормализация 16-битными словами - не больше одного слова на символ,
+    // поэтому декодер обходится без цикла. Контекст - предыдущий выбор
+    // столбца (kCount - начало чанка): ловит и перекос взвешенной
+    // стратегии, и предсказуемый следующий ход циклической. Символ i
+    // кодируется состоянием i % kRansStates: цепочки зависимостей
+    // состояний независимы, и декодер не упирается в задержку умножения.
+    static constexpr size_t kRansStates = 4;
+    static constexpr uint32_t kRansBits = 10;  // таблица декодера 6 x 1024 x 4 байта - в L1
+    static constexpr uint32_t kRansTotal = 1u << kRansBits;
+    static constexpr uint32_t kRansLow = 1u << 16;
+    static constexpr size_t kContexts = ChoiceHelper::kCount + 1;
+    using RansFrequencies = std::array<std::array<uint32_t, ChoiceHelper::kCount>, kContexts>;
+    
+    struct Column {
+        Encoding encoding;
+        std::vector<uint8_t> bytes;
+    };
+    
+    static void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+    
+    static uint64_t getVarint(const uint8_t*& pos, const uint8_t* end) {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos == end) {
+                break;
+            }
+            uint8_t byte = *pos++;
+            value |= uint64_t{byte & 0x7Fu} << shift;
+            if (byte < 0x80) {
+                return value;
+            }
+        }
+        throw std::runtime_error("повреждённый varint в экспорте");
+    }
+    
+    static uint32_t zigzag(int64_t value) {
+        return static_cast<uint32_t>((value << 1) ^ (value >> 63));
+    }
+    
+    static int64_t unzigzag(uint32_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+    
+    // Длина числа в десятичной записи - для оценки размера CSV
+    static size_t decimalWidth(uint32_t value) {
+        size_t width = 1;
+        while (value >= 10) {
+            value /= 10;
+            width++;
+        }
+        return width;
+    }
+    
+    static Column encodeRle(const std::vector<uint32_t>& values) {
+        Column column{RLE, {}};
+        for (size_t i = 0; i < values.size(); ) {
+            size_t run = 1;
+            while (i + run < values.size() && values[i + run] == values[i]) {
+                run++;
+            }
+            putVarint(column.bytes, values[i]);
+            putVarint(column.bytes, run);
+            i += run;
+        }
+        return column;
+    }
+    
+    static Column encodeBitPacked(const std::vector<uint32_t>& values) {
+        uint32_t maxValue = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+        uint8_t width = 0;
+        while (width < 32 && (maxValue >> width) != 0) {
+            width++;
+        }
+        
+        Column column{BIT_PACKED, {width}};
+        column.bytes.reserve(1 + (values.size() * width + 7) / 8);
+        uint64_t buffer = 0;
+        unsigned bits = 0;
+        for (uint32_t value : values) {
+            buffer |= uint64_t{value} << bits;
+            bits += width;
+            while (bits >= 8) {
+                column.bytes.push_back(static_cast<uint8_t>(buffer));
+                buffer >>= 8;
+                bits -= 8;
+            }
+        }
+        if (bits > 0) {
+            column.bytes.push_back(static_cast<uint8_t>(buffer));
+        }
+        return column;
+    }
+    
+    // Меньшее из RLE и упаковки битов
+    static Column encode(const std::vector<uint32_t>& values) {
+        Column rle = encodeRle(values);
+        Column packed = encodeBitPacked(values);
+        return rle.bytes.size() < packed.bytes.size() ? std::move(rle) : std::move(packed);
+    }
+    
+    // Для столбца выборов - ещё и rANS
+    static Column encodeChoices(const std::vector<uint32_t>& choices) {
+        Column best = encode(choices);
+        Column rans = encodeRans(choices);
+        return rans.bytes.size() < best.bytes.size() ? std::move(rans) : std::move(best);
+    }
+    
+    // Частоты чанка по контекстам, нормированные к kRansTotal; у каждого
+    // встреченного символа не меньше 1. Модель полустатическая: таблица
+    // пишется в чанк, и декодер обходится поиском по таблице без обновлений.
+    static RansFrequencies ransFrequencies(const std::vector<uint32_t>& choices) {
+        RansFrequencies counts{};
+        size_t context = ChoiceHelper::kCount;
+        for (uint32_t choice : choices) {
+            counts[context][choice]++;
+            context = choice;
+        }
+        
+        for (auto& row : counts) {
+            uint64_t total = 0;
+            for (uint32_t count : row) {
+                total += count;
+            }
+            if (total == 0) {
+                continue;
+            }
+            uint32_t sum = 0;
+            size_t largest = 0;
+            for (size_t c = 0; c < row.size(); ++c) {
+                if (row[c] > 0) {
+                    row[c] = std::max<uint32_t>(1, static_cast<uint32_t>(row[c] * uint64_t{kRansTotal} / total));
+                }
+                sum += row[c];
+                if (row[c] > row[largest]) {
+                    largest = c;
+                }
+            }
+            row[largest] += kRansTotal - sum;
+        }
+        return counts;
+    }
+    
+    static Column encodeRans(const std::vector<uint32_t>& choices) {
+        RansFrequencies freq = ransFrequencies(choices);
+        Column column{RANS, {}};
+        for (const auto& row : freq) {
+            for (uint32_t f : row) {
+                putVarint(column.bytes, f);
+            }
+        }
+        
+        RansFrequencies start{};
+        for (size_t context = 0; context < kContexts; ++context) {
+            for (size_t c = 1; c < ChoiceHelper::kCount; ++c) {
+                start[context][c] = start[context][c - 1] + freq[context][c - 1];
+            }
+        }
+        
+        // rANS кодирует с конца; слова потока собираются в обратном порядке
+        std::vector<uint16_t> stream;
+        stream.reserve(choices.size() / 8 + 16);
+        std::array<uint32_t, kRansStates> states;
+        states.fill(kRansLow);
+        for (size_t i = choices.size(); i-- > 0; ) {
+            uint32_t& x = states[i % kRansStates];
+            size_t context = i == 0 ? ChoiceHelper::kCount : choices[i - 1];
+            uint32_t f = freq[context][choices[i]];
+            uint64_t xMax = uint64_t{(kRansLow >> kRansBits) << 16} * f;
+            if (x >= xMax) {
+                stream.push_back(static_cast<uint16_t>(x));
+                x >>= 16;
+            }
+            x = ((x / f) << kRansBits) + (x % f) + start[context][choices[i]];
+        }
+        
+        for (uint32_t x : states) {
+            for (int shift = 0; shift < 32; shift += 8) {
+                column.bytes.push_back(static_cast<uint8_t>(x >> shift));
+            }
+        }
+        for (auto word = stream.rbegin(); word != stream.rend(); ++word) {
+            column.bytes.push_back(static_cast<uint8_t>(*word));
+            column.bytes.push_back(static_cast<uint8_t>(*word >> 8));
+        }
+        return column;
+    }
+    
+    static std::vector<uint32_t> decodeRans(const uint8_t* data, size_t size, size_t rows) {
+        const uint8_t* pos = data;
+        const uint8_t* end = data + size;
+        RansFrequencies freq{};
+        for (auto& row : freq) {
+            // Каждая частота ограничивается до суммирования: иначе сумма
+            // может переполниться, пройти проверку и увести запись за slots
+            uint64_t sum = 0;
+            for (uint32_t& f : row) {
+                uint64_t value = getVarint(pos, end);
+                if (value > kRansTotal) {
+                    throw std::runtime_error("повреждённая таблица частот rANS");
+                }
+                f = static_cast<uint32_t>(value);
+                sum += f;
+            }
+            if (sum != 0 && sum != kRansTotal) {
+                throw std::runtime_error("повреждённая таблица частот rANS");
+            }
+        }
+        
+        // Слот -> (частота << 16 | начало интервала << 4 | символ), по контексту.
+        // Контекст зависит от предыдущего символа, так что цепочка загрузок
+        // последовательна, и таблица должна помещаться в L1.
+        std::vector<uint32_t> slots(kContexts * kRansTotal);
+        for (size_t context = 0; context < kContexts; ++context) {
+            uint32_t begin = 0;
+            for (uint32_t c = 0; c < ChoiceHelper::kCount; ++c) {
+                for (uint32_t k = 0; k < freq[context][c]; ++k) {
+                    slots[context * kRansTotal + begin + k] = freq[context][c] << 16 | begin << 4 | c;
+                }
+                begin += freq[context][c];
+            }
+        }
+        
+        if (end - pos < static_cast<ptrdiff_t>(4 * kRansStates)) {
+            throw std::runtime_error("повреждённый поток rANS");
+        }
+        std::array<uint32_t, kRansStates> states;
+        for (uint32_t& x : states) {
+            x = pos[0] | (pos[1] << 8) | (pos[2] << 16) | (uint32_t{pos[3]} << 24);
+            pos += 4;
+        }
+        
+        // Поток с двумя нулевыми байтами в конце: слово читается всегда,
+        // а берётся без ветвления - иначе переходы на подкачке
+        // непредсказуемы и стоят больше самого декодирования
+        size_t streamBytes = static_cast<size_t>(end - pos);
+        std::vector<uint8_t> stream(pos, end);
+        stream.resize(streamBytes + 2);
+        
+        std::vector<uint32_t> choices(rows);
+        const uint32_t* table = slots.data();
+        const uint8_t* words = stream.data();
+        size_t at = 0;
+        bool corrupt = false;
+        uint32_t context = ChoiceHelper::kCount;
+        auto decodeOne = [&](uint32_t& x) {
+            uint32_t slot = table[context * kRansTotal + (x & (kRansTotal - 1))];
+            uint32_t f = slot >> 16;
+            x = f * (x >> kRansBits) + (x & (kRansTotal - 1)) - ((slot >> 4) & 0xFFF);
+            bool refill = x < kRansLow;
+            uint32_t word = words[at] | (words[at + 1] << 8);
+            x = refill ? (x << 16) | word : x;
+            corrupt |= f == 0 || (refill && at + 2 > streamBytes);
+            at = std::min(at + 2 * refill, streamBytes);
+            context = slot & 0xF;
+            return context;
+        };
+        
+        uint32_t* out = choices.data();
+        size_t i = 0;
+        for (; i + kRansStates <= rows; i += kRansStates) {
+            for (size_t k = 0; k < kRansStates; ++k) {
+                out[i + k] = decodeOne(states[k]);
+            }
+        }
+        for (; i < rows; ++i) {
+            out[i] = decodeOne(states[i % kRansStates]);
+        }
+        if (corrupt) {
+            throw std::runtime_error("повреждённый поток rANS");
+        }
+        return choices;
+    }
+    
+    static std::vector<uint32_t> decode(Encoding encoding, const uint8_t* data, size_t size,
+                                        size_t rows) {
+        if (encoding == RANS) {
+            return decodeRans(data, size, rows);
+        }
+        
+        std::vector<uint32_t> values;
+        values.reserve(rows);
+        const uint8_t* pos = data;
+        const uint8_t* end = data + size;
+        
+        if (encoding == RLE) {
+            while (values.size() < rows) {
+                uint32_t value = static_cast<uint32_t>(getVarint(pos, end));
+                uint64_t run = getVarint(pos, end);
+                if (run == 0 || run > rows - values.size()) {
+                    throw std::runtime_error("повреждённая серия RLE в экспорте");
+                }
+                values.insert(values.end(), run, value);
+            }
+            return values;
+        }
+        
+        if (encoding == BIT_PACKED && size >= 1 && data[0] <= 32 &&
+            size - 1 >= (rows * data[0] + 7) / 8) {
+            unsigned width = data[0];
+            uint64_t mask = (uint64_t{1} << width) - 1;
+            uint64_t buffer = 0;
+            unsigned bits = 0;
+            pos = data + 1;
+            for (size_t i = 0; i < rows; ++i) {
+                while (bits < width) {
+                    buffer |= uint64_t{*pos++} << bits;
+                    bits += 8;
+                }
+                values.push_back(static_cast<uint32_t>(buffer & mask));
+                buffer >>= width;
+                bits -= width;
+            }
+            return values;
+        }
+        throw std::runtime_error("неизвестное кодирование столбца в экспорте");
+    }
+};
+
+
+// Столбцовый экспорт истории турнира: строка - одна попытка одного игрока
+// (игрок, раунд, выбор, победы, поражения). Строки копятся по игрокам и
+// уходят в чанк, когда игрок выбывает, поэтому в чанке строки одного игрока
+// идут подряд и по возрастанию раунда: id сжимается RLE, раунд - RLE по
+// разностям, выбор и счёт - упаковкой битов.
+//
+// Файл: "RPSC", версия (1 байт), затем чанки:
+//   u32 строк, затем 5 столбцов: u8 кодирование, u32 байт, данные
+class HistoryExport {
+public:
+    static constexpr char kMagic[4] = {'R', 'P', 'S', 'C'};
+    static constexpr uint8_t kVersion = 2;   // 2 - столбец выборов может быть в rANS
+    static constexpr size_t kColumns = 5;
+    static constexpr size_t kChunkRows = 1 << 16;
+    
+    HistoryExport(const std::string& path, AsyncFileWriter::Backend backend, unsigned threads)
+        : out_(AsyncFileWriter::open(path, backend, threads)) {
+        out_->append(kMagic, sizeof(kMagic));
+        out_->append(&kVersion, 1);
+        bytes_ = sizeof(kMagic) + 1;
+        Metrics::add(Metrics::EXPORT_BYTES, bytes_);
+    }
+    
+    ~HistoryExport() {
+        try {
+            finish();
+        } catch (const std::exception&) {
+        }
+    }
+    
+    // Итоги попытки группы (key - раунд и переигровка)
+    void record(const DrawKey& key, const ScoreList& scores) {
+        for (const auto& score : scores) {
+            uint32_t id = score.player->getId();
+            if (id >= pending_.size()) {
+                pending_.resize(id + 1);
+            }
+            pending_[id].push_back({key.round, static_cast<uint32_t>(score.choice),
+                                    static_cast<uint32_t>(score.wins),
+                                    static_cast<uint32_t>(score.losses)});
+        }
+    }
+    
+    // Игрок выбыл (или турнир окончен) - его строки переходят в чанк
+    void retire(const Player& player) {
+        uint32_t id = player.getId();
+        if (id >= pending_.size()) {
+            return;
+        }
+        for (const auto& row : pending_[id]) {
+            uint32_t previous = columns_[1].empty() ? 0 : columns_[1].back();
+            columns_[0].push_back(id);
+            columns_[1].push_back(row.round);
+            roundDeltas_.push_back(ColumnCodec::zigzag(int64_t{row.round} - previous));
+            columns_[2].push_back(row.choice);
+            columns_[3].push_back(row.wins);
+            columns_[4].push_back(row.losses);
+            csvBytes_ += ColumnCodec::decimalWidth(id) + ColumnCodec::decimalWidth(row.round)
+                       + ColumnCodec::decimalWidth(row.wins) + ColumnCodec::decimalWidth(row.losses)
+                       + 1 + kColumns;
+        }
+        std::vector<Row>().swap(pending_[id]);
+        
+        if (columns_[0].size() >= kChunkRows) {
+            flushChunk();
+        }
+    }
+    
+    void finish() {
+        if (!finished_) {
+            finished_ = true;
+            flushChunk();
+            out_->finish();
+        }
+    }
+    
+    size_t rows() const { return rows_; }
+    size_t bytes() const { return bytes_; }
+    size_t csvBytes() const { return csvBytes_; }
+    const char* backendName() const { return out_->backendName(); }
+    
+private:
+    struct Row {
+        uint32_t round;
+        uint32_t choice;
+        uint32_t wins;
+        uint32_t losses;
+    };
+    
+    std::unique_ptr<AsyncFileWriter> out_;
+    std::vector<std::vector<Row>> pending_;   // по id игрока
+    std::array<std::vector<uint32_t>, kColumns> columns_;
+    std::vector<uint32_t> roundDeltas_;
+    size_t rows_ = 0;
+    size_t bytes_ = 0;
+    size_t csvBytes_ = 0;
+    bool finished_ = false;
+    
+    void writeU32(uint32_t value) {
+        uint8_t le[4] = {static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8),
+                         static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 24)};
+        out_->append(le, sizeof(le));
+        bytes_ += sizeof(le);
+    }
+    
+    void writeColumn(const ColumnCodec::Column& column) {
+        uint8_t encoding = column.encoding;
+        out_->append(&encoding, 1);
+        bytes_ += 1;
+        writeU32(static_cast<uint32_t>(column.bytes.size()));
+        out_->append(column.bytes.data(), column.bytes.size());
+        bytes_ += column.bytes.size();
+    }
+    
+    void flushChunk() {
+        size_t rows = columns_[0].size();
+        if (rows == 0) {
+            return;
+        }
+        Trace::Span span("чанк экспорта", static_cast<int64_t>(rows));
+        size_t before = bytes_;
+        writeU32(static_cast<uint32_t>(rows));
+        writeColumn(ColumnCodec::encodeRle(columns_[0]));
+        writeColumn(ColumnCodec::encodeRle(roundDeltas_));
+        writeColumn(ColumnCodec::encodeChoices(columns_[2]));
+        for (size_t c = 3; c < kColumns; ++c) {
+            writeColumn(ColumnCodec::encode(columns_[c]));
+        }
+        rows_ += rows;
+        Metrics::add(Metrics::EXPORT_BYTES, bytes_ - before);
+        for (auto& column : columns_) {
+            column.clear();
+        }
+        roundDeltas_.clear();
+    }
+};
+
+
+// Чтение экспорта: каталог чанков строится одним проходом по заголовкам,
+// затем пары (чанк, столбец) декодируются и сворачиваются параллельно -
+// столбцы независимы, соединять строки для сводки не нужно.
+class ExportReader {
+public:
+    struct Summary {
+        size_t rows = 0;
+        size_t chunks = 0;
+        size_t players = 0;
+        uint32_t maxRound = 0;
+        std::array<size_t, ChoiceHelper::kCount> choices{};
+        uint64_t wins = 0;
+        uint64_t losses = 0;
+        size_t fileBytes = 0;
+        size_t csvBytes = 0;
+    };
+    
+    static Summary scan(const std::string& path, unsigned threads) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("не удалось открыть " + path);
+        }
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        
+        constexpr size_t kHeader = sizeof(HistoryExport::kMagic) + 1;
+        if (data.size() < kHeader || !std::equal(HistoryExport::kMagic, HistoryExport::kMagic + 4,
+                                                 data.begin()) ||
+            data[4] == 0 || data[4] > HistoryExport::kVersion) {
+            throw std::runtime_error(path + " - не экспорт истории");
+        }
+        
+        std::vector<ColumnRef> refs;
+        size_t pos = kHeader;
+        while (pos < data.size()) {
+            uint32_t rows = readU32(data, pos);
+            for (size_t c = 0; c < HistoryExport::kColumns; ++c) {
+                ColumnRef ref;
+                ref.column = c;
+                ref.rows = rows;
+                ref.encoding = static_cast<ColumnCodec::Encoding>(data.at(pos++));
+                ref.size = readU32(data, pos);
+                ref.offset = pos;
+                if (ref.size > data.size() - pos) {
+                    throw std::runtime_error("экспорт обрезан");
+                }
+                pos += ref.size;
+                refs.push_back(ref);
+            }
+        }
+        
+        std::vector<Summary> partial(refs.size());
+        size_t chunks = std::max<size_t>(1, std::min<size_t>(threads, refs.size()));
+        std::vector<std::exception_ptr> errors(chunks);
+        Parallel::forChunks(refs.size(), chunks, [&](size_t begin, size_t end, size_t chunk) {
+            try {
+                for (size_t i = begin; i < end; ++i) {
+                    partial[i] = scanColumn(refs[i], data.data());
+                }
+            } catch (...) {
+                errors[chunk] = std::current_exception();
+            }
+        });
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+        
+        Summary summary;
+        summary.chunks = refs.size() / HistoryExport::kColumns;
+        summary.fileBytes = data.size();
+        for (size_t i = 0; i < refs.size(); ++i) {
+            const Summary& part = partial[i];
+            if (refs[i].column == 0) {
+                summary.rows += refs[i].rows;
+            }
+            summary.players += part.players;
+            summary.maxRound = std::max(summary.maxRound, part.maxRound);
+            for (size_t c = 0; c < ChoiceHelper::kCount; ++c) {
+                summary.choices[c] += part.choices[c];
+            }
+            summary.wins += part.wins;
+            summary.losses += part.losses;
+            summary.csvBytes += part.csvBytes;
+        }
+        return summary;
+    }
+    
+private:
+    struct ColumnRef {
+        size_t column;
+        size_t rows;
+        ColumnCodec::Encoding encoding;
+        size_t offset;
+        size_t size;
+    };
+    
+    static uint32_t readU32(const std::vector<uint8_t>& data, size_t& pos) {
+        if (data.size() - pos < 4) {
+            throw std::runtime_error("экспорт обрезан");
+        }
+        uint32_t value = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16)
+                       | (uint32_t{data[pos + 3]} << 24);
+        pos += 4;
+        return value;
+    }
+    
+    // Сводка одного столбца одного чанка; csvBytes - его доля в CSV
+    // (число и разделитель)
+    static Summary scanColumn(const ColumnRef& ref, const uint8_t* data) {
+        std::vector<uint32_t> values = ColumnCodec::decode(ref.encoding, data + ref.offset,
+                                                           ref.size, ref.rows);
+        Summary part;
+        switch (ref.column) {
+            case 0:
+                // Строки игрока идут подряд и не делятся между чанками
+                for (size_t i = 0; i < values.size(); ++i) {
+                    part.players += i == 0 || values[i] != values[i - 1];
+                    part.csvBytes += ColumnCodec::decimalWidth(values[i]) + 1;
+                }
+                break;
+            case 1: {
+                int64_t round = 0;
+                for (uint32_t delta : values) {
+                    round += ColumnCodec::unzigzag(delta);
+                    part.maxRound = std::max(part.maxRound, static_cast<uint32_t>(round));
+                    part.csvBytes += ColumnCodec::decimalWidth(static_cast<uint32_t>(round)) + 1;
+                }
+                break;
+            }
+            case 2:
+                for (uint32_t choice : values) {
+                    if (choice >= ChoiceHelper::kCount) {
+                        throw std::runtime_error("неверный выбор в экспорте");
+                    }
+                    part.choices[choice]++;
+                }
+                part.csvBytes = 2 * values.size();
+                break;
+            default:
+                for (uint32_t value : values) {
+                    (ref.column == 3 ? part.wins : part.losses) += value;
+                    part.csvBytes += ColumnCodec::decimalWidth(value) + 1;
+                }
+                break;
+        }
+        return part;
+    }
+};
+
+
+// Дополняет строку пробелами до width символов (хотя бы одним). setw считает байты,
+// а русские имена в UTF-8 занимают по два байта на букву.
+inline size_t displayWidth(const std::string& text) {
+    return static_cast<size_t>(std::count_if(text.begin(), text.end(),
+        [](char ch) { return (static_cast<unsigned char>(ch) & 0xC0) != 0x80; }));
+}
+
+inline std::string padRight(const std::string& text, size_t width) {
+    size_t length = displayWidth(text);
+    return text + std::string(length < width ? width - length : 1, ' ');
+}
+
+inline std::string padLeft(const std::string& text, size_t width) {
+    size_t length = displayWidth(text);
+    return std::string(length < width ? width - length : 1, ' ') + text;
+}
+
+
+// Аппаратные счётчики по фазам движка (--profile). Счётчики perf_event_open
+// открываются на поток движка с inherit (потоки std::async завершаются
+// внутри фазы, и их счёт добавляется к родителю) и отдельно на каждый
+// рабочий Parallel - те живут весь процесс, и inherit их счёт не отдал бы.
+// Недоступные счётчики (виртуальная машина, perf_event_paranoid) пропускаются,
+// время по часам считается всегда.
+class PhaseProfiler {
+public:
+    enum Phase { COLLECT, SCORE, LOSERS, DIVIDE, OUTPUT, kPhases };
+    enum Counter { WALL_NS, TASK_NS, CYCLES, INSTRUCTIONS, BRANCH_MISSES, CACHE_MISSES, DTLB_MISSES,
+                   kCounters };
+    using Sample = std::array<uint64_t, kCounters>;
+    
+    // Замер фазы на время жизни объекта; с nullptr ничего не делает
+    class Scope {
+    public:
+        Scope(PhaseProfiler* profiler, Phase phase) : profiler_(profiler), phase_(phase) {
+            if (profiler_) {
+                start_ = profiler_->sample();
+            }
+        }
+        ~Scope() {
+            if (profiler_) {
+                profiler_->add(phase_, start_, profiler_->sample());
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        
+    private:
+        PhaseProfiler* profiler_;
+        Phase phase_;
+        Sample start_{};
+    };
+    
+    // threads - потоков движка: рабочие Parallel запускаются заранее
+    explicit PhaseProfiler(unsigned threads) {
+#ifdef RPSLS_HAVE_PERF_EVENTS
+        const std::pair<uint32_t, uint64_t> events[kCounters] = {
+            {0, 0},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HW_CACHE, kDtlbReadMiss}
+        };
+        for (size_t c = TASK_NS; c < kCounters; ++c) {
+            counters_[c] = openCounter(events[c].first, events[c].second, threads);
+        }
+#else
+        (void)threads;
+#endif
+    }
+    
+#ifdef RPSLS_HAVE_PERF_EVENTS
+    static constexpr uint64_t kDtlbReadMiss = PERF_COUNT_HW_CACHE_DTLB |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+#endif
+    
+    // Счётчик потока tid (0 - текущего), включая потоки, созданные им после
+    // открытия; -1, если ядро или виртуализация его не дают
+    static int openEvent(uint32_t type, uint64_t config, pid_t tid = 0) {
+#ifdef RPSLS_HAVE_PERF_EVENTS
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(::syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0));
+#else
+        (void)type;
+        (void)config;
+        (void)tid;
+        return -1;
+#endif
+    }
+    
+    // Счётчик на весь движок: текущий поток и все рабочие Parallel (их до
+    // threads - 1 запускается заранее). Пусто, если счётчик недоступен.
+    static std::vector<int> openCounter(uint32_t type, uint64_t config, unsigned threads) {
+        std::vector<int> fds;
+        int own = openEvent(type, config);
+        if (own < 0) {
+            return fds;
+        }
+        fds.push_back(own);
+        Parallel::reserveWorkers(threads > 0 ? threads - 1 : 0);
+        for (pid_t tid : Parallel::workerTids()) {
+            int fd = openEvent(type, config, tid);
+            if (fd >= 0) {
+                fds.push_back(fd);
+            }
+        }
+        return fds;
+    }
+    
+    static bool readCounter(const std::vector<int>& fds, uint64_t& value) {
+        value = 0;
+        bool ok = !fds.empty();
+        for (int fd : fds) {
+            uint64_t part = 0;
+            ok = readEvent(fd, part) && ok;
+            value += part;
+        }
+        return ok;
+    }
+    
+    static void closeCounter(std::vector<int>& fds) {
+        for (int fd : fds) {
+            ::close(fd);
+        }
+        fds.clear();
+    }
+    
+    static bool readEvent(int fd, uint64_t& value) {
+        uint64_t values[3];  // значение, время включения, время счёта
+        if (fd < 0 || ::read(fd, values, sizeof(values)) != sizeof(values)) {
+            return false;
+        }
+        // При мультиплексировании счётчик работал не всё время - масштабируем
+        value = values[2] > 0 && values[2] < values[1]
+              ? static_cast<uint64_t>(static_cast<double>(values[0]) * values[1] / values[2])
+              : values[0];
+        return true;
+    }
+    
+    ~PhaseProfiler() {
+        for (auto& counter : counters_) {
+            closeCounter(counter);
+        }
+    }
+    
+    PhaseProfiler(const PhaseProfiler&) = delete;
+    PhaseProfiler& operator=(const PhaseProfiler&) = delete;
+    
+    void beginRound(int round) {
+        rounds_.push_back({round, {}});
+    }
+    
+    void report() const {
+        std::cout << "\n  Профиль по фазам (мс - по часам, ЦП мс - время всех потоков фазы)\n";
+        std::string missing;
+        for (size_t c = TASK_NS; c < kCounters; ++c) {
+            if (counters_[c].empty()) {
+                missing += std::string(missing.empty() ? "" : ", ") + kCounterNames[c];
+            }
+        }
+        if (!missing.empty()) {
+            std::cout << "  Недоступны счётчики: " << missing << "\n";
+        }
+        
+        std::cout << "  " << padRight("Раунд", 7) << padRight("Фаза", 14);
+        for (size_t c = 0; c < kCounters; ++c) {
+            std::cout << padLeft(kCounterNames[c], 14);
+        }
+        std::cout << std::setw(8) << "IPC" << "\n";
+        
+        RoundStats total{0, {}};
+        for (const auto& round : rounds_) {
+            printRound(std::to_string(round.round), round);
+            for (size_t p = 0; p < kPhases; ++p) {
+                for (size_t c = 0; c < kCounters; ++c) {
+                    total.phases[p][c] += round.phases[p][c];
+                }
+            }
+        }
+        printRound("всего", total);
+    }
+    
+private:
+    struct RoundStats {
+        int round;
+        std::array<Sample, kPhases> phases;
+    };
+    
+    static constexpr const char* kPhaseNames[kPhases] = {
+        "выбор", "подсчёт", "выбывание", "группы", "вывод"
+    };
+    static constexpr const char* kCounterNames[kCounters] = {
+        "мс", "ЦП мс", "циклы", "инструкции", "пром. ветвл.", "пром. кэша", "пром. TLB"
+    };
+    
+    std::array<std::vector<int>, kCounters> counters_;
+    std::vector<RoundStats> rounds_;
+    
+    Sample sample() const {
+        Sample now{};
+        now[WALL_NS] = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+        for (size_t c = TASK_NS; c < kCounters; ++c) {
+            readCounter(counters_[c], now[c]);
+        }
+        return now;
+    }
+    
+    void add(Phase phase, const Sample& start, const Sample& end) {
+        if (rounds_.empty()) {
+            beginRound(0);
+        }
+        for (size_t c = 0; c < kCounters; ++c) {
+            rounds_.back().phases[phase][c] += end[c] - start[c];
+        }
+    }
+    
+    void printRound(const std::string& label, const RoundStats& round) const {
+        for (size_t p = 0; p < kPhases; ++p) {
+            const Sample& s = round.phases[p];
+            if (s[WALL_NS] == 0) {
+                continue;
+            }
+            std::cout << "  " << padRight(label, 7) << padRight(kPhaseNames[p], 14) << std::fixed;
+            for (size_t c = 0; c < kCounters; ++c) {
+                if (c != WALL_NS && counters_[c].empty()) {
+                    std::cout << std::setw(14) << "-";
+                } else if (c == WALL_NS || c == TASK_NS) {
+                    std::cout << std::setw(14) << std::setprecision(3) << s[c] / 1e6;
+                } else {
+                    std::cout << std::setw(14) << s[c];
+                }
+            }
+            if (!counters_[CYCLES].empty() && !counters_[INSTRUCTIONS].empty() && s[CYCLES] > 0) {
+                std::cout << std::setw(8) << std::setprecision(2)
+                          << static_cast<double>(s[INSTRUCTIONS]) / s[CYCLES];
+            }
+            std::cout << "\n";
+        }
+    }
+};
+
+
+// Разбор параметров вида ключ=значение,ключ=значение
+inline std::vector<std::pair<std::string, std::string>> parseKeyValues(const std::string& spec,
+                                                                       const std::string& what) {
+    std::vector<std::pair<std::string, std::string>> items;
+    std::istringstream in(spec);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos || eq + 1 == item.size()) {
+            throw std::invalid_argument("неверный параметр " + what + " " + item);
+        }
+        items.emplace_back(item.substr(0, eq), item.substr(eq + 1));
+    }
+    return items;
+}
+
+// Параметры --evolve
+struct EvolutionSettings {
+    size_t generations = 20;
+    size_t population = 24;
+    size_t tournaments = 8;   // турниров на геном в поколении
+    size_t team = 4;          // ботов генома в турнире
+    size_t field = 28;        // стандартных ботов против них
+    std::string out = "evolution.txt";
+    
+    static EvolutionSettings parse(const std::string& spec) {
+        EvolutionSettings settings;
+        for (const auto& [name, value] : parseKeyValues(spec, "эволюции")) {
+            if (name == "out") {
+                settings.out = value;
+            } else if (name == "generations") {
+                settings.generations = std::stoul(value);
+            } else if (name == "population") {
+                settings.population = std::stoul(value);
+            } else if (name == "tournaments") {
+                settings.tournaments = std::stoul(value);
+            } else if (name == "team") {
+                settings.team = std::stoul(value);
+            } else if (name == "field") {
+                settings.field = std::stoul(value);
+            } else {
+                throw std::invalid_argument("неизвестный параметр эволюции " + name);
+            }
+        }
+        if (settings.generations == 0 || settings.population < 2 ||
+            settings.tournaments == 0 || settings.team == 0 || settings.field == 0) {
+            throw std::invalid_argument("эволюции нужны поколения, популяция от 2, турниры, команда и поле");
+        }
+        return settings;
+    }
+};
+
+
+// Параметры --replicator
+struct ReplicatorSettings {
+    size_t types = 64;         // видов стратегий (не меньше 7 встроенных)
+    size_t steps = 1000000;
+    double dt = 0.01;          // шаг по времени, не больше 0.5
+    size_t population = 0;     // 0 - бесконечная популяция, иначе шум размера N
+    size_t report = 0;         // печатать доли каждые report шагов (0 - только итог)
+    
+    static ReplicatorSettings parse(const std::string& spec) {
+        ReplicatorSettings settings;
+        for (const auto& [name, value] : parseKeyValues(spec, "репликатора")) {
+            if (name == "types") {
+                settings.types = std::stoul(value);
+            } else if (name == "steps") {
+                settings.steps = std::stoul(value);
+            } else if (name == "dt") {
+                settings.dt = std::stod(value);
+            } else if (name == "population") {
+                settings.population = std::stoul(value);
+            } else if (name == "report") {
+                settings.report = std::stoul(value);
+            } else {
+                throw std::invalid_argument("неизвестный параметр репликатора " + name);
+            }
+        }
+        if (settings.types < 7 || settings.steps == 0 || !(settings.dt > 0.0 && settings.dt <= 0.5)) {
+            throw std::invalid_argument("репликатору нужно от 7 видов, шаги и 0 < dt <= 0.5");
+        }
+        return settings;
+    }
+};
+
+
+// Параметры --verify-scoring
+struct VerifySettings {
+    size_t rounds = 1000000;
+    size_t max = 64;           // наибольшая обычная группа (размеры лог-равномерно от 2)
+    size_t large = 4;          // групп от RoundManager::kParallelGroup (параллельный путь)
+    
+    static VerifySettings parse(const std::string& spec) {
+        VerifySettings settings;
+        for (const auto& [name, value] : parseKeyValues(spec, "сверки")) {
+            if (name == "rounds") {
+                settings.rounds = std::stoul(value);
+            } else if (name == "max") {
+                settings.max = std::stoul(value);
+            } else if (name == "large") {
+                settings.large = std::stoul(value);
+            } else {
+                throw std::invalid_argument("неизвестный параметр сверки " + name);
+            }
+        }
+        if (settings.rounds == 0 || settings.max < 2) {
+            throw std::invalid_argument("сверке нужны раунды и группы от 2");
+        }
+        return settings;
+    }
+};
+
+
+// Параметры --bench. Списки через двоеточие, каждая комбинация - отдельный
+// тихий турнир. Пустой threads - 1, 2, 4, ... до числа ядер, пустые
+// pages, layout и prefetch - значения --huge-pages, --group-layout и --prefetch.
+struct BenchSettings {
+    std::vector<size_t> threads;
+    std::vector<size_t> players{10, 1000, 100000, 1000000};
+    std::vector<size_t> groups{4, 16, 256};
+    std::vector<HugePages::Mode> pages;
+    std::vector<bool> packed;  // layout: pointer - объекты на местах, packed - --group-layout
+    std::vector<size_t> prefetch;
+    bool json = false;
+    std::string out;           // пусто - в stdout
+    
+    static BenchSettings parse(const std::string& spec) {
+        BenchSettings settings;
+        for (const auto& [name, value] : parseKeyValues(spec, "замера")) {
+            if (name == "threads") {
+                settings.threads = parseList(value);
+            } else if (name == "players") {
+                settings.players = parseList(value);
+            } else if (name == "groups") {
+                settings.groups = parseList(value);
+            } else if (name == "pages") {
+                std::istringstream in(value);
+                std::string mode;
+                while (std::getline(in, mode, ':')) {
+                    settings.pages.push_back(HugePages::parse(mode));
+                }
+            } else if (name == "prefetch") {
+                settings.prefetch = parseList(value);
+            } else if (name == "layout") {
+                std::istringstream in(value);
+                std::string layout;
+                while (std::getline(in, layout, ':')) {
+                    if (layout != "pointer" && layout != "packed") {
+                        throw std::invalid_argument("раскладка замера pointer или packed, а не " + layout);
+                    }
+                    settings.packed.push_back(layout == "packed");
+                }
+            } else if (name == "format") {
+                if (value != "csv" && value != "json") {
+                    throw std::invalid_argument("формат замера csv или json, а не " + value);
+                }
+                settings.json = value == "json";
+            } else if (name == "out") {
+                settings.out = value;
+            } else {
+                throw std::invalid_argument("неизвестный параметр замера " + name);
+            }
+        }
+        for (size_t players : settings.players) {
+            if (players < 2 || players > static_cast<size_t>(std::numeric_limits<int>::max())) {
+                throw std::invalid_argument("в замере нужно от 2 игроков");
+            }
+        }
+        for (size_t group : settings.groups) {
+            if (group == 1) {
+                throw std::invalid_argument("размер группы должен быть 0 или не меньше 2");
+            }
+        }
+        if (std::find(settings.threads.begin(), settings.threads.end(), 0) != settings.threads.end()) {
+            throw std::invalid_argument("в замере нужен хотя бы один поток");
+        }
+        return settings;
+    }
+    
+    static std::vector<size_t> parseList(const std::string& value) {
+        std::vector<size_t> items;
+        std::istringstream in(value);
+        std::string item;
+        while (std::getline(in, item, ':')) {
+            items.push_back(std::stoul(item));
+        }
+        if (items.empty()) {
+            throw std::invalid_argument("пустой список в замере");
+        }
+        return items;
+    }
+};
+
+
+// Параметры --what-if: тихий турнир ботов до раунда round, затем branches
+// веток с разными зёрнами. Если задан player (место в составе), каждая ветка
+// играется дважды с одним зерном: как есть и с ходом choice (1-5) у player.
+struct WhatIfSettings {
+    static constexpr size_t kNoPlayer = std::numeric_limits<size_t>::max();
+    
+    size_t players = 1000;
+    int round = 3;
+    size_t branches = 1000;
+    size_t player = kNoPlayer;
+    Choice choice = Choice::SPOCK;
+    
+    static WhatIfSettings parse(const std::string& spec) {
+        WhatIfSettings settings;
+        for (const auto& [name, value] : parseKeyValues(spec, "ветвления")) {
+            if (name == "players") {
+                settings.players = std::stoul(value);
+            } else if (name == "round") {
+                settings.round = std::stoi(value);
+            } else if (name == "branches") {
+                settings.branches = std::stoul(value);
+            } else if (name == "player") {
+                settings.player = std::stoul(value);
+            } else if (name == "choice") {
+                settings.choice = ChoiceHelper::fromInput(value);
+            } else {
+                throw std::invalid_argument("неизвестный параметр ветвления " + name);
+            }
+        }
+        if (settings.players < 2 || settings.players > static_cast<size_t>(std::numeric_limits<int>::max()) ||
+            settings.round < 1 || settings.branches == 0 ||
+            (settings.player != kNoPlayer && settings.player >= settings.players)) {
+            throw std::invalid_argument("ветвлению нужны от 2 игроков, раунд от 1, ветки и игрок из состава");
+        }
+        return settings;
+    }
+};
+
+
+struct GameOptions {
+    enum class Mode { PLAY, CHECK_ALLOCATIONS, CHECK_METRICS, EVOLVE, REPLICATOR, READ_EXPORT, VERIFY_SCORING,
+                      BENCH, WHAT_IF };
+    // Подсчёт очков: AUTO - гистограмма для больших групп, PAIRWISE - эталон O(n^2)
+    enum class Scoring { AUTO, PAIRWISE, HISTOGRAM };
+    
+    Mode mode = Mode::PLAY;
+    uint64_t seed = 0;
+    EliminationPolicy elimination;
+    size_t groupSize = 4;     // 0 - все в одной группе
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool quiet = false;       // без поединков, таблиц и пауз - для больших турниров
+    bool silent = false;      // quiet и без заголовков раундов - для вложенных турниров
+    EvolutionSettings evolution;
+    ReplicatorSettings replicator;
+    VerifySettings verify;
+    BenchSettings bench;
+    WhatIfSettings whatIf;
+    Scoring scoring = Scoring::AUTO;
+    HugePages::Mode hugePages = HugePages::Mode::OFF;
+    std::string exportPath;   // столбцовый экспорт истории (PLAY) или файл для READ_EXPORT
+    AsyncFileWriter::Backend ioBackend = AsyncFileWriter::Backend::AUTO;
+    bool profile = false;     // счётчики по фазам, отчёт в конце турнира
+    bool groupLayout = false; // перекладывать игроков в память подряд в порядке групп
+    size_t prefetch = 4;      // подкачивать группы на столько шагов вперёд (0 - нет)
+    std::string tracePath;    // Chrome trace JSON по завершении
+    std::string metricsAddress;  // PORT или unix:/путь для Prometheus
+    
+    // Настройки вложенного турнира: без вывода, профиля и экспорта - иначе
+    // параллельные турниры перезаписывали бы один файл истории
+    GameOptions headless(unsigned workers) const {
+        GameOptions options = *this;
+        options.quiet = options.silent = true;
+        options.profile = false;
+        options.exportPath.clear();
+        options.threads = workers;
+        return options;
+    }
+};
+
+
+class RoundManager {
+public:
+    using ChoiceList = std::vector<std::pair<Player*, Choice>,
+                                   HugePageAllocator<std::pair<Player*, Choice>>>;
+    
+    // Группы от этого размера считаются параллельно на options.threads потоках
+    static constexpr size_t kParallelGroup = 1 << 14;
+    static constexpr size_t kMinChunk = 1 << 12;
+    
+    explicit RoundManager(const GameOptions& options = {}) : options_(options) {}
+    virtual ~RoundManager() = default;
+    
+    // Куда писать итоги попыток (nullptr - никуда)
+    void setExport(HistoryExport* history) { export_ = history; }
+    void setProfiler(PhaseProfiler* profiler) { profiler_ = profiler; }
+    
+    // Возвращает список проигравших (пустой = ничья, нужна переигровка).
+    // key задаёт раунд/группу/переигровку, поле player заполняется здесь.
+    // speculated - заранее запущенный расчёт ходов ботов для этого же key.
+    // Буферы раунда - члены менеджера, поэтому список действителен до
+    // следующего вызова, а прогретый тихий раунд ботов не выделяет память.
+    const std::vector<Player*>& executeRound(const Group& group, const DrawKey& key,
+                                             const std::string& groupName = "",
+                                             std::future<ChoiceList> speculated = {}) {
+        Metrics::add(Metrics::ATTEMPTS);
+        Metrics::add(Metrics::DUELS, uint64_t{group.size()} * (group.size() - 1) / 2);
+        
+        {
+            PhaseProfiler::Scope phase(profiler_, PhaseProfiler::COLLECT);
+            collectChoices(group, key, groupName, std::move(speculated));
+        }
+        
+        if (!options_.quiet) {
+            PhaseProfiler::Scope phase(profiler_, PhaseProfiler::OUTPUT);
+            printChoices(choices_, groupName);
+        }
+        
+        {
+            PhaseProfiler::Scope phase(profiler_, PhaseProfiler::SCORE);
+            calculateScores(choices_, scores_);
+            reportResults(scores_, group.numBots());
+        }
+        
+        {
+            PhaseProfiler::Scope phase(profiler_, PhaseProfiler::OUTPUT);
+            if (export_) {
+                export_->record(key, scores_);
+            }
+            if (!options_.quiet) {
+                printAllComparisons(choices_, groupName);
+                printScoreTable(scores_, groupName);
+            }
+        }
+        
+        PhaseProfiler::Scope phase(profiler_, PhaseProfiler::LOSERS);
+        return determineLosers(scores_, groupName);
+    }
+    
+    // Ходы ботов не зависят от ходов людей текущего раунда (у каждого свой
+    // поток CounterRng), поэтому их можно посчитать в фоне, пока люди думают.
+    // Результат - полный список выборов группы с заполненными слотами ботов.
+    // Боты группы не должны одновременно играть в другой группе.
+    std::future<ChoiceList> speculateBotChoices(const Group& group, DrawKey key) {
+        return std::async(std::launch::async, [this, &group, key]() {
+            ChoiceList choices(group.size());
+            fillBotChoices(group, key, choices.data());
+            return choices;
+        });
+    }
+    
+protected:
+    using Histogram = std::array<size_t, ChoiceHelper::kCount>;
+    
+    // Ботов за один вызов generateBulk: буферы пакета лежат на стеке
+    static constexpr size_t kBotBatch = 256;
+    
+    // Один проход без проверок типа: слоты [0, numBots) - боты,
+    // [numBots, size) - люди, как и раньше в выводе. Результат - в choices_.
+    void collectChoices(const Group& group, DrawKey key,
+                        const std::string& groupName,
+                        std::future<ChoiceList> speculated) {
+        
+        if (!groupName.empty() && !options_.quiet) {
+            std::cout << "\n  [" << groupName << "] Игроки делают выбор...\n";
+        }
+        
+        std::future<void> bots;
+        if (speculated.valid()) {
+            // Посчитано заранее, пока ходила предыдущая группа
+            choices_ = speculated.get();
+        } else {
+            choices_.resize(group.size());
+            if (group.hasHumans()) {
+                bots = std::async(std::launch::async, [this, &group, key]() {
+                    fillBotChoices(group, key, choices_.data());
+                });
+            } else {
+                fillBotChoices(group, key, choices_.data());
+            }
+        }
+        
+        auto* humanSlots = choices_.data() + group.numBots();
+        for (size_t i = 0; i < group.numHumans; ++i) {
+            Player* human = group.humans()[i];
+            key.player = human->getId();
+            CounterRng rng(key);
+            humanSlots[i] = {human, human->makeChoice(rng)};
+        }
+        
+        if (bots.valid()) {
+            bots.get();
+        }
+    }
+    
+    // Боты независимы, поэтому большая группа делится между потоками
+    void fillBotChoices(const Group& group, const DrawKey& key, std::pair<Player*, Choice>* out) {
+        Player* const* bots = group.bots();
+        size_t chunks = chunksFor(group.numBots());
+        Parallel::forChunks(group.numBots(), chunks, [&](size_t begin, size_t end, size_t) {
+            Trace::Span span("ходы ботов", static_cast<int64_t>(end - begin));
+            Metrics::add(Metrics::BOT_MOVES, end - begin);
+            fillBotRange(bots + begin, end - begin, key, out + begin);
+        });
+    }
+    
+    // Первые случайные блоки ботов куска считаются пакетами по kBotBatch.
+    // Состояния в менеджере нет: так же вызывается из фоновой спекуляции.
+    static void fillBotRange(Player* const* bots, size_t numBots, DrawKey key,
+                             std::pair<Player*, Choice>* out) {
+        std::array<uint32_t, kBotBatch> botIds;
+        std::array<CounterRng::Block, kBotBatch> blocks;
+        for (size_t base = 0; base < numBots; base += kBotBatch) {
+            size_t batch = std::min(kBotBatch, numBots - base);
+            for (size_t i = 0; i < batch; ++i) {
+                botIds[i] = bots[base + i]->getId();
+            }
+            CounterRng::generateBulk(key, botIds.data(), batch, blocks.data());
+            
+            for (size_t i = 0; i < batch; ++i) {
+                key.player = botIds[i];
+                CounterRng rng(key, blocks[i]);
+                out[base + i] = {bots[base + i], bots[base + i]->makeChoice(rng)};
+            }
+        }
+    }
+    
+    size_t chunksFor(size_t n) const {
+        if (n < kParallelGroup) {
+            return 1;
+        }
+        return Parallel::chunkCount(n, options_.threads, kMinChunk);
+    }
+    
+    // Итоги попытки - ботам (они первые numBots записей), для обучения стратегий
+    void reportResults(const ScoreList& scores, size_t numBots) {
+        int opponents = static_cast<int>(scores.size()) - 1;
+        Parallel::forChunks(numBots, chunksFor(numBots), [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i) {
+                scores[i].player->observeResult(scores[i].choice, scores[i].wins,
+                                                scores[i].losses, opponents);
+            }
+        });
+    }
+    
+    // Очки пишутся в scores, его память переиспользуется между попытками
+    void calculateScores(const ChoiceList& choices, ScoreList& scores) {
+        switch (options_.scoring) {
+            case GameOptions::Scoring::PAIRWISE:
+                return calculateScoresPairwise(choices, scores);
+            case GameOptions::Scoring::HISTOGRAM:
+                return calculateScoresHistogram(choices, scores);
+            case GameOptions::Scoring::AUTO:
+                break;
+        }
+        if (choices.size() >= kParallelGroup) {
+            return calculateScoresHistogram(choices, scores);
+        }
+        calculateScoresPairwise(choices, scores);
+    }
+    
+    // Результат игрока зависит только от его выбора и числа соперников с
+    // каждым выбором: гистограмма собирается параллельной редукцией,
+    // затем очки раздаются параллельно. O(n) вместо O(n^2).
+    void calculateScoresHistogram(const ChoiceList& choices, ScoreList& scores) {
+        size_t n = choices.size();
+        size_t chunks = chunksFor(n);
+        
+        histograms_.resize(chunks);
+        Parallel::forChunks(n, chunks, [&](size_t begin, size_t end, size_t chunk) {
+            Histogram local{};
+            for (size_t i = begin; i < end; ++i) {
+                local[ChoiceHelper::index(choices[i].second)]++;
+            }
+            histograms_[chunk] = local;
+        });
+        
+        Histogram total{};
+        for (const auto& local : histograms_) {
+            for (size_t c = 0; c < ChoiceHelper::kCount; ++c) {
+                total[c] += local[c];
+            }
+        }
+        
+        std::array<int, ChoiceHelper::kCount> winsFor{}, lossesFor{};
+        for (size_t c = 0; c < ChoiceHelper::kCount; ++c) {
+            for (size_t d = 0; d < ChoiceHelper::kCount; ++d) {
+                if (GameRules::beats(static_cast<Choice>(c), static_cast<Choice>(d))) {
+                    winsFor[c] += static_cast<int>(total[d]);
+                } else if (GameRules::beats(static_cast<Choice>(d), static_cast<Choice>(c))) {
+                    lossesFor[c] += static_cast<int>(total[d]);
+                }
+            }
+        }
+        
+        scores.resize(n);
+        Parallel::forChunks(n, chunks, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i) {
+                size_t c = ChoiceHelper::index(choices[i].second);
+                scores[i] = {choices[i].first, choices[i].second, winsFor[c], lossesFor[c]};
+            }
+        });
+    }
+    
+    // Эталон: все пары через GameRules::compare. Быстрые пути сверяются
+    // с ним в --verify-scoring, менять его можно только вместе с правилами.
+    void calculateScoresPairwise(const ChoiceList& choices, ScoreList& scores) {
+        scores.clear();
+        for (const auto& [player, choice] : choices) {
+            scores.push_back({player, choice, 0, 0});
+        }
+        
+        for (size_t i = 0; i < scores.size(); ++i) {
+            for (size_t j = i + 1; j < scores.size(); ++j) {
+                DuelResult result = GameRules::compare(scores[i].choice, scores[j].choice);
+                
+                switch (result) {
+                    case DuelResult::WIN:
+                        scores[i].wins++;
+                        scores[j].losses++;
+                        break;
+                    case DuelResult::LOSE:
+                        scores[i].losses++;
+                        scores[j].wins++;
+                        break;
+                    case DuelResult::DRAW:
+                        break;
+                }
+            }
+        }
+    }
+    
+    void printChoices(const ChoiceList& choices,
+                      const std::string& groupName) {
+        if (!groupName.empty()) {
             std::cout << "\n  [" << groupName << "] Выборы игроков:\n";
         } else {
-            std::cout << "\n  Выборы игроков:\n";
+            std::cout << "\n  Выборы игроков:\n";
+        }
+        for (const auto& [player, choice] : choices) {
+            std::cout << "    " << player->getName() << ": " 
+                      << ChoiceHelper::toString(choice) << "\n";
+        }
+    }
+    
+    void printAllComparisons(const ChoiceList& choices,
+                             const std::string& groupName) {
+        if (!groupName.empty()) {
+            std::cout << "\n  [" << groupName << "] Сравнения:\n";
+        } else {
+            std::cout << "\n  Сравнения:\n";
+        }
+        
+        for (size_t i = 0; i < choices.size(); ++i) {
+            for (size_t j = i + 1; j < choices.size(); ++j) {
+                const auto& [player1, choice1] = choices[i];
+                const auto& [player2, choice2] = choices[j];
+                
+                DuelResult result = GameRules::compare(choice1, choice2);
+                
+                if (result == DuelResult::DRAW) {
+                    std::cout << "    " << player1->getName() << " = " 
+                              << player2->getName() << " (ничья)\n";
+                } else if (result == DuelResult::WIN) {
+                    std::cout << "    " << player1->getName() << " > " 
+                              << player2->getName() << " -- "
+                              << GameRules::getDescription(choice1, choice2) << "\n";
+                } else {
+                    std::cout << "    " << player2->getName() << " > " 
+                              << player1->getName() << " -- "
+                              << GameRules::getDescription(choice2, choice1) << "\n";
+                }
+            }
+        }
+    }
+    
+    void printScoreTable(const ScoreList& scores,
+                         const std::string& groupName) {
+        if (!groupName.empty()) {
+            std::cout << "\n  [" << groupName << "] Итоги:\n";
+        } else {
+            std::cout << "\n  Итоги раунда:\n";
+        }
+
+        auto sortedScores = scores;
+        std::sort(sortedScores.begin(), sortedScores.end(),
+            [](const PlayerScore& a, const PlayerScore& b) {
+                if (a.getNetScore() != b.getNetScore()) {
+                    return a.getNetScore() > b.getNetScore();
+                }
+                return a.wins > b.wins;
+            });
+        
+        for (const auto& score : sortedScores) {
+            std::string balanceStr;
+            int net = score.getNetScore();
+            if (net > 0) balanceStr = "+" + std::to_string(net);
+            else balanceStr = std::to_string(net);
+            
+            std::cout << "    " << score.player->getName() 
+                      << " -- " << score.wins << "W/" << score.losses << "L"
+                      << " (баланс: " << balanceStr << ")\n";
+        }
+    }
+    
+    // Выбывают игроки с балансом ниже порога политики. Ничьи на пороге не
+    // разбиваются: пороговый блок выбывает целиком, если так число выбывших
+    // ближе к цели политики (и кто-то остаётся), иначе остаётся целиком.
+    // Если на пороге минимальный баланс - это классическое правило.
+    const std::vector<Player*>& determineLosers(ScoreList& scores,
+                                                const std::string& groupName) {
+        size_t chunks = chunksFor(scores.size());
+        losers_.clear();
+        
+        // Находим минимальный и максимальный баланс (редукция по кускам)
+        extremes_.resize(chunks);
+        Parallel::forChunks(scores.size(), chunks, [&](size_t begin, size_t end, size_t chunk) {
+            int lo = scores[begin].getNetScore();
+            int hi = lo;
+            for (size_t i = begin; i < end; ++i) {
+                lo = std::min(lo, scores[i].getNetScore());
+                hi = std::max(hi, scores[i].getNetScore());
+            }
+            extremes_[chunk] = {lo, hi};
+        });
+        int minNetScore = extremes_[0].first;
+        int maxNetScore = extremes_[0].second;
+        for (const auto& [lo, hi] : extremes_) {
+            minNetScore = std::min(minNetScore, lo);
+            maxNetScore = std::max(maxNetScore, hi);
+        }
+        
+        // Если у всех одинаковый баланс - ничья, переигровка
+        if (minNetScore == maxNetScore) {
+            if (options_.quiet) {
+                return losers_;
+            } else if (!groupName.empty()) {
+                std::cout << "\n  [" << groupName << "] Ничья! Переигровка...\n";
+            } else {
+                std::cout << "\n  Ничья! Переигровка...\n";
+            }
+            return losers_; // Пустой список = переигровка
+        }
+        
+        int cutoff = minNetScore + 1;
+        if (options_.elimination.kind != EliminationPolicy::Kind::MIN_SCORE) {
+            size_t survivors = options_.elimination.targetSurvivors(scores.size());
+            nets_.resize(scores.size());
+            for (size_t i = 0; i < scores.size(); ++i) {
+                nets_[i] = scores[i].getNetScore();
+            }
+            std::nth_element(nets_.begin(), nets_.begin() + (survivors - 1), nets_.end(),
+                             std::greater<int>());
+            int boundary = nets_[survivors - 1];
+            
+            size_t target = scores.size() - survivors;
+            size_t below = static_cast<size_t>(std::count_if(nets_.begin(), nets_.end(),
+                [boundary](int net) { return net < boundary; }));
+            size_t atOrBelow = static_cast<size_t>(std::count_if(nets_.begin(), nets_.end(),
+                [boundary](int net) { return net <= boundary; }));
+            
+            bool keepBlock = below > 0 &&
+                (atOrBelow == scores.size() || target - below <= atOrBelow - target);
+            cutoff = keepBlock ? boundary : boundary + 1;
+        }
+        
+        // Собираем проигравших: каждый кусок отдельно, затем по порядку.
+        // Ёмкость сразу под худший случай, чтобы память набиралась на первой
+        // же большой группе, а не по мере роста числа выбывших.
+        if (partialLosers_.size() < chunks) {
+            partialLosers_.resize(chunks);
+        }
+        losers_.reserve(scores.size());
+        Parallel::forChunks(scores.size(), chunks, [&](size_t begin, size_t end, size_t chunk) {
+            std::vector<Player*>& partial = partialLosers_[chunk];
+            partial.clear();
+            partial.reserve(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                if (scores[i].getNetScore() < cutoff) {
+                    partial.push_back(scores[i].player);
+                }
+            }
+        });
+        for (size_t c = 0; c < chunks; ++c) {
+            losers_.insert(losers_.end(), partialLosers_[c].begin(), partialLosers_[c].end());
+        }
+        
+        if (options_.quiet) {
+            return losers_;
+        }
+        
+        for (const auto& score : scores) {
+            if (score.getNetScore() < cutoff) {
+                if (!groupName.empty()) {
+                    std::cout << "\n  [" << groupName << "] " << score.player->getName() 
+                              << " выбывает! (" << score.wins << "W/" << score.losses << "L)\n";
+                } else {
+                    std::cout << "\n  " << score.player->getName() 
+                              << " выбывает! (" << score.wins << "W/" << score.losses << "L)\n";
+                }
+            }
+        }
+        
+        return losers_;
+    }
+    
+private:
+    GameOptions options_;
+    HistoryExport* export_ = nullptr;
+    PhaseProfiler* profiler_ = nullptr;
+    
+    // Буферы попытки: растут до самой большой группы и дальше не выделяются
+    ChoiceList choices_;
+    ScoreList scores_;
+    std::vector<Histogram> histograms_;
+    std::vector<std::pair<int, int>> extremes_;
+    std::vector<int> nets_;
+    std::vector<std::vector<Player*>> partialLosers_;
+    std::vector<Player*> losers_;
+};
+
+
+// Сверка --verify-scoring: случайные раунды всех размеров с перекошенными
+// распределениями выборов считаются эталоном и каждым быстрым путём,
+// любое расхождение в очках - ошибка. Новый путь подсчёта добавляется
+// в engines() и сразу попадает под сверку.
+class ScoringVerifier : private RoundManager {
+public:
+    explicit ScoringVerifier(const GameOptions& options)
+        : RoundManager(options), settings_(options.verify), seed_(options.seed) {}
+    
+    bool run() {
+        using Clock = std::chrono::steady_clock;
+        using Engine = void (ScoringVerifier::*)(const ChoiceList&, ScoreList&);
+        struct Candidate {
+            const char* name;
+            Engine engine;
+            double seconds = 0.0;
+            size_t mismatches = 0;
+        };
+        std::vector<Candidate> candidates;
+        for (const auto& [name, engine] : engines()) {
+            candidates.push_back({name, engine});
+        }
+        
+        size_t largest = std::max(settings_.max, settings_.large ? 2 * kParallelGroup : 0);
+        std::vector<std::unique_ptr<Player>> players;
+        players.reserve(largest);
+        for (size_t i = 0; i < largest; ++i) {
+            players.push_back(PlayerFactory::createComputer(seed_));
+        }
+        
+        size_t total = settings_.rounds + settings_.large;
+        std::cout << "\n  Сверка подсчёта очков: зерно " << seed_ << ", раундов " << total
+                  << " (до " << settings_.max << " игроков, больших " << settings_.large << ")\n";
+        
+        double referenceSeconds = 0.0;
+        uint64_t duels = 0;
+        ChoiceList choices;
+        ScoreList expected, actual;
+        for (size_t round = 0; round < total; ++round) {
+            CounterRng rng({seed_, static_cast<uint32_t>(round), DrawKey::kService, 1, 0});
+            size_t size = round < settings_.rounds
+                ? logUniformSize(rng, settings_.max)
+                : kParallelGroup + rng.below(static_cast<uint32_t>(kParallelGroup));
+            generate(rng, players, size, choices);
+            duels += uint64_t{size} * (size - 1) / 2;
+            
+            auto start = Clock::now();
+            calculateScoresPairwise(choices, expected);
+            referenceSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+            
+            for (auto& candidate : candidates) {
+                start = Clock::now();
+                (this->*candidate.engine)(choices, actual);
+                candidate.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+                if (!compare(expected, actual, candidate.name, round)) {
+                    candidate.mismatches++;
+                }
+            }
+        }
+        
+        std::cout << "  Поединков " << duels << ", эталон " << std::fixed << std::setprecision(3)
+                  << referenceSeconds << " с\n";
+        bool ok = true;
+        for (const auto& candidate : candidates) {
+            std::cout << "    " << padRight(candidate.name, 12) << candidate.mismatches
+                      << " расхождений, " << std::setprecision(3) << candidate.seconds << " с, x"
+                      << std::setprecision(1) << referenceSeconds / std::max(candidate.seconds, 1e-9)
+                      << " к эталону\n";
+            ok = ok && candidate.mismatches == 0;
+        }
+        std::cout << (ok ? "  OK\n" : "  ОШИБКА: быстрые пути расходятся с эталоном\n");
+        return ok;
+    }
+    
+private:
+    static constexpr size_t kShownMismatches = 5;
+    
+    // Все пути, кроме эталона. Большие раунды гистограммы идут параллельно.
+    static std::vector<std::pair<const char*, void (ScoringVerifier::*)(const ChoiceList&, ScoreList&)>>
+    engines() {
+        return {{"гистограмма", &ScoringVerifier::calculateScoresHistogram}};
+    }
+    
+    // Лог-равномерно: маленьких групп много, но каждый порядок размера представлен
+    static size_t logUniformSize(CounterRng& rng, size_t max) {
+        double size = std::exp(rng.uniform() * std::log(static_cast<double>(max) / 2.0)) * 2.0;
+        return std::min(max, std::max<size_t>(2, static_cast<size_t>(size)));
+    }
+    
+    // Распределения по очереди: равномерное, случайное с симплекса в степени
+    // (сильный перекос), одна доминирующая фигура, только две фигуры, все одинаковые
+    static void generate(CounterRng& rng, const std::vector<std::unique_ptr<Player>>& players,
+                         size_t size, ChoiceList& choices) {
+        std::array<float, ChoiceHelper::kCount> weights;
+        weights.fill(0.0f);
+        uint32_t first = rng.below(ChoiceHelper::kCount);
+        switch (rng.below(5)) {
+            case 0:
+                weights.fill(1.0f);
+                break;
+            case 1:
+                for (float& w : weights) {
+                    w = std::pow(-std::log(1.0f - rng.uniform()), 4.0f);
+                }
+                break;
+            case 2:
+                weights.fill(0.02f);
+                weights[first] = 1.0f;
+                break;
+            case 3:
+                weights[first] = 1.0f;
+                weights[(first + 1 + rng.below(ChoiceHelper::kCount - 1)) % ChoiceHelper::kCount] =
+                    rng.uniform();
+                break;
+            default:
+                weights[first] = 1.0f;
+                break;
+        }
+        float sum = 0.0f;
+        for (float w : weights) {
+            sum += w;
+        }
+        
+        choices.resize(size);
+        for (size_t i = 0; i < size; ++i) {
+            float x = rng.uniform() * sum;
+            size_t c = 0;
+            while (c + 1 < ChoiceHelper::kCount && (x -= weights[c]) >= 0.0f) {
+                ++c;
+            }
+            if (weights[c] == 0.0f) {
+                c = first;
+            }
+            choices[i] = {players[i].get(), static_cast<Choice>(c)};
+        }
+    }
+    
+    bool compare(const ScoreList& expected, const ScoreList& actual,
+                 const char* name, size_t round) {
+        bool same = expected.size() == actual.size();
+        size_t bad = 0;
+        for (size_t i = 0; same && i < expected.size(); ++i) {
+            const auto& e = expected[i];
+            const auto& a = actual[i];
+            if (e.player != a.player || e.choice != a.choice || e.wins != a.wins ||
+                e.losses != a.losses) {
+                same = false;
+                bad = i;
+            }
+        }
+        if (!same && shown_++ < kShownMismatches) {
+            std::cout << "    " << name << ", раунд " << round << ", игроков " << expected.size();
+            if (expected.size() != actual.size()) {
+                std::cout << ": получено " << actual.size() << " записей\n";
+            } else {
+                std::cout << ": игрок " << bad << " " << ChoiceHelper::toString(expected[bad].choice)
+                          << " ожидалось " << expected[bad].wins << "W/" << expected[bad].losses
+                          << "L, получено " << actual[bad].wins << "W/" << actual[bad].losses << "L\n";
+            }
+        }
+        return same;
+    }
+    
+    VerifySettings settings_;
+    uint64_t seed_;
+    size_t shown_ = 0;
+};
+
+
+// Класс для разделения на группы
+class GroupDivider {
+private:
+    uint64_t seed_;
+    size_t groupSize_;
+    // Буферы жеребьёвки переиспользуются от раунда к раунду
+    std::vector<Player*, HugePageAllocator<Player*>> shuffled_;
+    std::vector<int> groupSizes_;
+    
+public:
+    GroupDivider(uint64_t seed, size_t groupSize) : seed_(seed), groupSize_(groupSize) {}
+    
+    // Разделяет игроков на группы по 2-G человек (G = groupSize, по умолчанию 4;
+    // при G = 2 нечётный остаток даёт одну тройку)
+    // Ни один игрок не должен остаться без группы.
+    // groups перезаполняется; группы прошлого раунда отдают свою ёмкость.
+    void divideIntoGroups(const std::vector<Player*>& players, uint32_t round,
+                          std::vector<Group>& groups) {
+        // Перемешиваем игроков (жеребьёвка раунда - отдельный поток).
+        // Перемешивание берёт около одного числа на игрока, состав - не больше
+        // INT_MAX игроков: поток жеребьёвки не может дойти до повтора.
+        static_assert(2 * uint64_t{std::numeric_limits<int>::max()} < CounterRng::kMaxDraws);
+        shuffled_.assign(players.begin(), players.end());
+        CounterRng rng({seed_, round, DrawKey::kService, DrawKey::kService, 0});
+        std::shuffle(shuffled_.begin(), shuffled_.end(), rng);
+        
+        int n = static_cast<int>(shuffled_.size());
+        
+        // Алгоритм разбиения:
+        // - Стараемся набрать группы по G
+        // - Если остаток 1, то заменяем одну полную группу на (G-1)+2
+        //   (при G = 2 - последняя пара становится тройкой)
+        // - Если остаток больше 1, добавляем группу из остатка
+        
+        int fullSize = static_cast<int>(groupSize_);
+        int numFull = n / fullSize;
+        int remainder = n % fullSize;
+        
+        if (remainder == 1 && fullSize == 2) {
+            // (numFull-1) пар, затем 3
+            groupSizes_.assign(numFull - 1, 2);
+            groupSizes_.push_back(3);
+        } else if (remainder == 1) {
+            // (numFull-1) групп по G, затем G-1 и 2
+            groupSizes_.assign(numFull - 1, fullSize);
+            groupSizes_.push_back(fullSize - 1);
+            groupSizes_.push_back(2);
+        } else {
+            // numFull групп по G, затем остаток (если есть)
+            groupSizes_.assign(numFull, fullSize);
+            if (remainder > 0) {
+                groupSizes_.push_back(remainder);
+            }
+        }
+        
+        // Заполняем группы
+        groups.resize(groupSizes_.size());
+        size_t idx = 0;
+        for (size_t g = 0; g < groupSizes_.size(); ++g) {
+            size_t end = std::min(idx + static_cast<size_t>(groupSizes_[g]), shuffled_.size());
+            groups[g].assign(shuffled_.data() + idx, shuffled_.data() + end);
+            idx = end;
+        }
+    }
+};
+
+
+class Game {
+private:
+    GameOptions options_;
+    // Арены объявлены раньше players_: разрушаются после игроков в них
+    LayoutArena retired_;
+    LayoutArena layout_;
+    CowRoster players_;
+    std::vector<uint32_t> slotOfId_;  // id игрока -> индекс в players_ (для --group-layout)
+    std::unique_ptr<RoundManager> roundManager_;
+    std::unique_ptr<GroupDivider> groupDivider_;
+    std::unique_ptr<HistoryExport> export_;
+    std::unique_ptr<PhaseProfiler> profiler_;
+    int roundNumber_ = 0;
+    size_t active_ = 0;               // активных игроков, пересчитывается в advance()
+    std::vector<double> roundSeconds_;
+    // Буферы раунда: состав только сокращается, так что после первого
+    // раунда ёмкости хватает и раунд ботов не выделяет память
+    std::vector<Player*> activePlayers_;
+    std::vector<Group> groups_;
+    
+    // Активные игроки раунда - их раунд меняет, поэтому в ветке они
+    // отделяются от общих с другими ветками (CowRoster::mutableAt).
+    // Ссылка действительна до следующего вызова.
+    const std::vector<Player*>& getActivePlayers() {
+        activePlayers_.clear();
+        for (size_t slot = 0; slot < players_.size(); ++slot) {
+            if (players_[slot].isActive()) {
+                activePlayers_.push_back(players_.mutableAt(slot));
+            }
+        }
+        return activePlayers_;
+    }
+    
+    size_t countActive() const {
+        size_t count = 0;
+        for (size_t slot = 0; slot < players_.size(); ++slot) {
+            count += players_[slot].isActive();
+        }
+        return count;
+    }
+    
+    int readInt(const std::string& prompt) {
+        while (true) {
+            std::cout << prompt << std::flush;
+            std::string input;
+            std::getline(std::cin, input);
+            
+            try {
+                return std::stoi(input);
+            } catch (...) {
+                std::cout << "  Введите целое число!\n";
+            }
+        }
+    }
+    
+    void adopt(std::vector<std::unique_ptr<Player>> players) {
+        players_.assign(std::move(players));
+    }
+    
+    // --group-layout: игроки раунда перекладываются в новую арену подряд в
+    // порядке групп (стратегия сразу за игроком), и группа обрабатывается
+    // по соседним строкам кэша, а не по разбросанным по куче объектам.
+    // Выбывшие из прошлой арены один раз уходят в retired_.
+    void relocateInGroupOrder(std::vector<Group>& groups) {
+        if (slotOfId_.empty()) {
+            uint32_t maxId = 0;
+            for (size_t slot = 0; slot < players_.size(); ++slot) {
+                maxId = std::max(maxId, players_[slot].getId());
+            }
+            slotOfId_.assign(size_t{maxId} + 1, 0);
+            for (size_t slot = 0; slot < players_.size(); ++slot) {
+                slotOfId_[players_[slot].getId()] = static_cast<uint32_t>(slot);
+            }
+        }
+        
+        LayoutArena next;
+        for (Group& group : groups) {
+            for (Player*& player : group.players) {
+                CowRoster::Entry& owner = players_.entry(slotOfId_[player->getId()]);
+                player = player->relocate(next);
+                owner = CowRoster::Entry(player, LayoutDeleter<Player>{LayoutDeleter<Player>::CURRENT});
+            }
+        }
+        for (size_t slot = 0; slot < players_.size(); ++slot) {
+            if (players_[slot].isActive()) {
+                continue;
+            }
+            CowRoster::Entry& owner = players_.entry(slot);
+            auto* deleter = std::get_deleter<LayoutDeleter<Player>>(owner);
+            if (deleter && deleter->where == LayoutDeleter<Player>::CURRENT) {
+                owner = CowRoster::Entry(owner->relocate(retired_),
+                                         LayoutDeleter<Player>{LayoutDeleter<Player>::RETIRED});
+            }
+        }
+        layout_ = std::move(next);
+    }
+    
+    DrawKey groupKey(uint32_t groupIndex) const {
+        return {options_.seed, static_cast<uint32_t>(roundNumber_), groupIndex, 0, 0};
+    }
+    
+    // Детерминированные боты с одинаковым состоянием (два синхронных
+    // циклических, UCB1 без наград) могут сыграть вничью бесконечно
+    static constexpr uint32_t kMaxReplays = 1000;
+    
+    void eliminatePlayer(Player* loser) {
+        loser->eliminate(roundNumber_);
+        active_--;
+        if (export_) {
+            export_->retire(*loser);
+        }
+    }
+    
+    // Проводит раунд в одной группе с переигровками до победителя.
+    // speculated - ходы ботов первой попытки, посчитанные заранее
+    void playGroupRound(Group& group, uint32_t groupIndex,
+                        const std::string& groupName,
+                        std::future<RoundManager::ChoiceList> speculated = {}) {
+        Trace::Span groupSpan("группа", groupIndex);
+        DrawKey key = groupKey(groupIndex);
+        while (true) {
+            Trace::Span attemptSpan(key.attempt == 0 ? "попытка" : "переигровка", key.attempt);
+            const std::vector<Player*>& losers = roundManager_->executeRound(
+                group, key, groupName, std::move(speculated));
+            
+            if (losers.empty()) {
+                // Ничья - переигровка
+                key.attempt++;
+                Metrics::add(Metrics::REPLAYS);
+                if (key.attempt < kMaxReplays) {
+                    continue;
+                }
+                // Переигровки не кончаются - выбывающего определяет жребий
+                key.player = DrawKey::kService;
+                Player* loser = group.players[CounterRng(key).below(
+                    static_cast<uint32_t>(group.size()))];
+                if (!options_.quiet) {
+                    std::cout << "\n  " << kMaxReplays << " ничьих подряд, жребий: "
+                              << loser->getName() << " выбывает\n";
+                }
+                eliminatePlayer(loser);
+            }
+            
+            // Деактивируем проигравших
+            for (auto* loser : losers) {
+                eliminatePlayer(loser);
+            }
+            
+            // Убираем проигравших из группы
+            group.removeInactive();
+            
+            break; // Раунд завершён
+        }
+    }
+    
+    // Конвейер подкачки на D групп вперёд: за 3D - массив указателей группы,
+    // за 2D - объекты игроков (указатели уже в кэше), за D - стратегии и
+    // истории (объекты уже в кэше). Каждая ступень читает только то, что
+    // подкачала предыдущая, и не ждёт памяти.
+    void prefetchAhead(const std::vector<Group>& groups, size_t current) const {
+        size_t distance = options_.prefetch;
+        if (size_t g = current + 3 * distance; g < groups.size()) {
+            __builtin_prefetch(groups[g].players.data());
+        }
+        if (size_t g = current + 2 * distance; g < groups.size()) {
+            for (const Player* player : groups[g].players) {
+                player->prefetchObject();
+            }
+        }
+        if (size_t g = current + distance; g < groups.size()) {
+            for (const Player* player : groups[g].players) {
+                player->prefetchState();
+            }
+        }
+    }
+    
+    // Делить на группы, если игроков больше G+1 (G = 4: больше 5)
+    bool needsGroups(size_t numPlayers) const {
+        return options_.groupSize > 0 && numPlayers > options_.groupSize + 1;
+    }
+    
+    // Проводит раунд для всех игроков (с разделением на группы если нужно)
+    void playRound(const std::vector<Player*>& activePlayers) {
+        if (needsGroups(activePlayers.size())) {
+            // Разделяем на группы
+            std::vector<Group>& groups = groups_;
+            {
+                PhaseProfiler::Scope phase(profiler_.get(), PhaseProfiler::DIVIDE);
+                groupDivider_->divideIntoGroups(activePlayers, roundNumber_, groups);
+                if (options_.groupLayout) {
+                    relocateInGroupOrder(groups);
+                }
+            }
+            
+            if (!options_.quiet) {
+                PhaseProfiler::Scope phase(profiler_.get(), PhaseProfiler::OUTPUT);
+                std::cout << "\n  Игроков много (" << activePlayers.size() 
+                          << "), разделяем на " << groups.size() << " групп(ы):\n";
+                for (size_t i = 0; i < groups.size(); ++i) {
+                    std::cout << "    Группа " << (i + 1) << ": ";
+                    for (size_t j = 0; j < groups[i].size(); ++j) {
+                        if (j > 0) std::cout << ", ";
+                        std::cout << groups[i].players[j]->getName();
+                    }
+                    std::cout << "\n";
+                }
+            }
+            
+            // Проводим раунд в каждой группе. Пока люди группы думают,
+            // боты следующей группы уже делают ход первой попытки.
+            std::future<RoundManager::ChoiceList> next;
+            for (size_t i = 0; i < groups.size(); ++i) {
+                if (options_.prefetch > 0) {
+                    prefetchAhead(groups, i);
+                }
+                std::future<RoundManager::ChoiceList> current = std::move(next);
+                if (i + 1 < groups.size() && groups[i].hasHumans()) {
+                    uint32_t nextIndex = static_cast<uint32_t>(i + 1);
+                    next = roundManager_->speculateBotChoices(groups[i + 1], groupKey(nextIndex));
+                }
+                
+                // Имя нужно только для вывода - в тихом режиме строку не строим
+                std::string groupName;
+                if (!options_.quiet) {
+                    groupName = "Группа " + std::to_string(i + 1);
+                    std::cout << "\n" << std::string(40, '-') << "\n";
+                }
+                playGroupRound(groups[i], static_cast<uint32_t>(i), groupName, std::move(current));
+            }
+            
+        } else {
+            // Играем все вместе с переигровками
+            groups_.resize(1);
+            groups_[0].assign(activePlayers.data(), activePlayers.data() + activePlayers.size());
+            playGroupRound(groups_[0], 0, "");
+        }
+    }
+    
+public:
+    explicit Game(const GameOptions& options)
+        : options_(options),
+          roundManager_(std::make_unique<RoundManager>(options)),
+          groupDivider_(std::make_unique<GroupDivider>(options.seed, options.groupSize)) {
+        if (!options.exportPath.empty()) {
+            export_ = std::make_unique<HistoryExport>(options.exportPath, options.ioBackend,
+                                                      options.threads);
+            roundManager_->setExport(export_.get());
+        }
+        if (options.profile) {
+            profiler_ = std::make_unique<PhaseProfiler>(options.threads);
+            roundManager_->setProfiler(profiler_.get());
+        }
+    }
+    
+    // Готовый состав без диалога setup() - для турниров без людей
+    Game(const GameOptions& options, std::vector<std::unique_ptr<Player>> players)
+        : Game(options) {
+        adopt(std::move(players));
+    }
+    
+    int rounds() const { return roundNumber_; }
+    
+    // Игрок по месту в исходном составе. С --group-layout объекты переезжают
+    // каждый раунд, поэтому указатели на игроков снаружи не хранятся.
+    const Player& player(size_t slot) const { return players_[slot]; }
+    size_t numPlayers() const { return players_.size(); }
+    
+    // Игрок, которого можно менять в этой ветке (вмешательство "что если")
+    Player* mutablePlayer(size_t slot) { return players_.mutableAt(slot); }
+    
+    // Ветка турнира с текущего раунда: состав общий до первой записи
+    // (CowRoster), генератор счётчиковый, поэтому его состояние - это
+    // зерно и номер раунда. С тем же зерном ветка повторяет турнир, с
+    // другим - жеребьёвка и ходы ботов со следующего раунда свои.
+    // Ветка тихая, без экспорта и профиля, на одном потоке: ветки сами
+    // играются параллельно, и вложенный forChunks лишь делил бы с ними ядра.
+    // --group-layout не поддерживается, так как перекладывание двигает
+    // общие объекты.
+    std::unique_ptr<Game> fork(uint64_t seed) const {
+        if (options_.groupLayout) {
+            throw std::logic_error("ветвление турнира несовместимо с --group-layout");
+        }
+        GameOptions options = options_.headless(1);
+        options.seed = seed;
+        auto branch = std::make_unique<Game>(options);
+        branch->players_ = players_;
+        branch->roundNumber_ = roundNumber_;
+        return branch;
+    }
+    const std::vector<double>& roundSeconds() const { return roundSeconds_; }
+    
+    void setup() {
+        std::cout << "\n" << std::string(60, '=') << "\n";
+        std::cout << "  КАМЕНЬ-НОЖНИЦЫ-БУМАГА-ЯЩЕРИЦА-СПОК\n";
+        std::cout << "  Режим: Все против всех\n";
+        std::cout << "  Ave Deus Mechanicus!\n";
+        std::cout << std::string(60, '=') << "\n";
+        
+        std::cout << "\n  Правила:\n";
+        std::cout << "  - Ножницы режут бумагу, бумага покрывает камень\n";
+        std::cout << "  - Камень давит ящерицу, ящерица отравляет Спока\n";
+        std::cout << "  - Спок ломает ножницы, ножницы обезглавливают ящерицу\n";
+        std::cout << "  - Ящерица съедает бумагу, на бумаге улики против Спока\n";
+        std::cout << "  - Спок испаряет камень, камень разбивает ножницы\n";
+        std::cout << "\n  Механика:\n";
+        std::cout << "  - Каждый раунд все делают выбор одновременно\n";
+        std::cout << "  - Игрок(и) с худшим балансом побед/поражений выбывают\n";
+        if (options_.elimination.kind != EliminationPolicy::Kind::MIN_SCORE) {
+            std::cout << "    (в каждой группе " << options_.elimination.describe() << ")\n";
+        }
+        std::cout << "  - При ничьей - переигровка\n";
+        if (options_.groupSize > 0) {
+            std::cout << "  - Если игроков > " << options_.groupSize + 1
+                      << ", они делятся на группы по 2-" << std::max<size_t>(options_.groupSize, 3) << "\n";
+        } else {
+            std::cout << "  - Все играют в одной группе\n";
         }
-        for (const auto& [player, choice] : choices) {
-            std::cout << "    " << player->getName() << ": " 
-                      << ChoiceHelper::toString(choice) << "\n";
+        std::cout << "  - Последний оставшийся - победитель!\n";
+        std::cout << "\n  Зерно турнира: " << options_.seed
+                  << " (повтор: --seed " << options_.seed << ")\n" << std::flush;
+        
+        int numHumans, numComputers;
+        
+        while (true) {
+            numHumans = readInt("\n  Количество игроков-людей: ");
+            if (numHumans < 0) {
+                std::cout << "  Число не может быть отрицательным!\n";
+                continue;
+            }
+            break;
+        }
+        
+        while (true) {
+            numComputers = readInt("  Количество игроков-компьютеров: ");
+            if (numComputers < 0) {
+                std::cout << "  Число не может быть отрицательным!\n";
+                continue;
+            }
+            
+            int total = numHumans + numComputers;
+            if (total < 2) {
+                std::cout << "  Для игры нужно минимум 2 участника!\n";
+                continue;
+            }
+            
+            if (numHumans == 1 && numComputers == 0) {
+                std::cout << "  Один игрок не может играть сам с собой,\n";
+                std::cout << "  Добавьте хотя бы одного компьютера.\n";
+                continue;
+            }
+            
+            break;
+        }
+        
+        std::cout << "\n";
+        adopt(PlayerFactory::createPlayers(numHumans, numComputers, options_.seed));
+        
+        if (options_.quiet) {
+            return;
+        }
+        
+        std::cout << "\n  Участники турнира:\n";
+        for (size_t slot = 0; slot < players_.size(); ++slot) {
+            std::cout << "    " << slot + 1 << ". " << players_[slot].getName() 
+                      << " (" << players_[slot].getType() << ")\n";
         }
     }
     
-    void printAllComparisons(const std::vector<std::pair<Player*, Choice>>& choices,
-                             const std::string& groupName) {
-        if (!groupName.empty()) {
-            std::cout << "\n  [" << groupName << "] Сравнения:\n";
+    // Играет до rounds раундов (0 - до конца). true - турнир окончен.
+    // Активные пересчитываются один раз: между вызовами игроков могли
+    // изменить через mutablePlayer.
+    bool advance(int rounds = 0) {
+        active_ = countActive();
+        // Каждый раунд выбывает хотя бы один игрок: места под время раундов
+        // хватит до конца турнира, и push_back не перевыделяет по ходу
+        if (active_ > 1) {
+            roundSeconds_.reserve(roundSeconds_.size() + active_ - 1);
+        }
+        for (int played = 0; active_ > 1; ++played) {
+            if (rounds > 0 && played == rounds) {
+                return false;
+            }
+            roundNumber_++;
+            Trace::Span roundSpan("раунд", roundNumber_);
+            const std::vector<Player*>& activePlayers = getActivePlayers();
+            if (profiler_) {
+                profiler_->beginRound(roundNumber_);
+            }
+            if (!options_.silent) {
+                Metrics::set(Metrics::ACTIVE_PLAYERS, static_cast<int64_t>(activePlayers.size()));
+            }
+            
+            if (!options_.silent) {
+                std::cout << "\n" << std::string(60, '=') << "\n";
+                std::cout << "  РАУНД " << roundNumber_ << "\n";
+                std::cout << "  Осталось игроков: " << activePlayers.size() << "\n";
+                std::cout << std::string(60, '=') << "\n";
+            }
+            
+            auto roundStart = std::chrono::steady_clock::now();
+            playRound(activePlayers);
+            roundSeconds_.push_back(std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - roundStart).count());
+            Metrics::add(Metrics::ROUNDS);
+            
+            if (active_ > 1 && !options_.quiet) {
+                std::cout << "\n  Нажмите Enter для продолжения...";
+                std::cin.get();
+            }
+        }
+        return true;
+    }
+    
+    // Возвращает победителя (nullptr - все выбыли одновременно)
+    Player* run() {
+        advance();
+        
+        const std::vector<Player*>& finalPlayers = getActivePlayers();
+        Player* winner = finalPlayers.empty() ? nullptr : finalPlayers[0];
+        if (export_) {
+            for (Player* player : finalPlayers) {
+                export_->retire(*player);
+            }
+            export_->finish();
+            if (!options_.silent) {
+                std::cout << "\n  История записана в " << options_.exportPath << ": "
+                          << export_->rows() << " строк, " << export_->bytes()
+                          << " байт (CSV - около " << export_->csvBytes() << " байт, запись "
+                          << export_->backendName() << ")\n";
+            }
+        }
+        if (options_.silent) {
+            return winner;
+        }
+        if (profiler_) {
+            profiler_->report();
+        }
+        if (winner) {
+            std::cout << "\n" << std::string(60, '=') << "\n";
+            std::cout << "  ПОБЕДИТЕЛЬ: " << winner->getName() << "\n";
+            std::cout << std::string(60, '=') << "\n";
         } else {
-            std::cout << "\n  Сравнения:\n";
+            std::cout << "\n  Все игроки выбыли одновременно, ничья\n";
+        }
+        return winner;
+    }
+};
+
+
+// Проверка --check-allocations: каждая встроенная стратегия делает ходы на
+// заранее зарезервированной истории, затем прогретые тихие попытки ботов
+// идут через RoundManager::executeRound, затем целые раунды Game с
+// жеребьёвкой и выбыванием. Ни одного operator new быть не должно.
+class AllocationCheck {
+public:
+    static bool run(uint64_t seed) {
+        if (!AllocationCounter::enabled()) {
+            std::cout << "  Счётчик выделений не собран, нужен -DRPSLS_COUNT_ALLOCATIONS\n";
+            return false;
         }
         
-        for (size_t i = 0; i < choices.size(); ++i) {
-            for (size_t j = i + 1; j < choices.size(); ++j) {
-                const auto& [player1, choice1] = choices[i];
-                const auto& [player2, choice2] = choices[j];
-                
-                DuelResult result = GameRules::compare(choice1, choice2);
-                
-                if (result == DuelResult::DRAW) {
-                    std::cout << "    " << player1->getName() << " = " 
-                              << player2->getName() << " (ничья)\n";
-                } else if (result == DuelResult::WIN) {
-                    std::cout << "    " << player1->getName() << " > " 
-                              << player2->getName() << " -- "
-                              << GameRules::getDescription(choice1, choice2) << "\n";
-                } else {
-                    std::cout << "    " << player2->getName() << " > " 
-                              << player1->getName() << " -- "
-                              << GameRules::getDescription(choice2, choice1) << "\n";
-                }
+        constexpr uint32_t kWarmup = 16;
+        constexpr uint32_t kMoves = 100000;
+        bool ok = true;
+        
+        for (uint32_t kind = 0; kind < PlayerFactory::kNumStrategies; ++kind) {
+            auto strategy = PlayerFactory::createStrategy(kind);
+            std::vector<Choice> history;
+            history.reserve(kWarmup + kMoves);
+            strategy->reserveHistory(kWarmup + kMoves);
+            
+            auto play = [&](uint32_t move) {
+                CounterRng rng({seed, move, 0, kind, 0});
+                history.push_back(strategy->makeChoice(history, rng));
+            };
+            
+            for (uint32_t move = 0; move < kWarmup; ++move) {
+                play(move);
             }
+            size_t before = AllocationCounter::count();
+            for (uint32_t move = kWarmup; move < kWarmup + kMoves; ++move) {
+                play(move);
+            }
+            size_t allocations = AllocationCounter::count() - before;
+            
+            std::cout << "    " << strategy->getName() << ": " << allocations
+                      << " выделений на " << kMoves << " ходов\n";
+            ok = ok && allocations == 0;
+        }
+        
+        for (const char* policy : {"min", "ratio:0.5"}) {
+            ok = checkRounds(seed, policy) && ok;
         }
+        ok = checkGame(seed) && ok;
+        
+        std::cout << (ok ? "  OK\n" : "  ОШИБКА: стратегии или раунды выделяют память\n");
+        return ok;
     }
     
-    void printScoreTable(const std::vector<PlayerScore>& scores,
-                         const std::string& groupName) {
-        if (!groupName.empty()) {
-            std::cout << "\n  [" << groupName << "] Итоги:\n";
-        } else {
-            std::cout << "\n  Итоги раунда:\n";
+private:
+    // Большая и малая группа по очереди: после прогрева буферы раунда
+    // не перевыделяются и при смене размера группы. Выбывания не применяются.
+    static bool checkRounds(uint64_t seed, const char* policy) {
+        constexpr size_t kBots = 64;
+        constexpr size_t kSmall = 4;
+        constexpr uint32_t kWarmup = 16;
+        constexpr uint32_t kAttempts = 20000;
+        
+        GameOptions options = GameOptions{}.headless(1);
+        options.seed = seed;
+        options.elimination = EliminationPolicy::parse(policy);
+        RoundManager manager(options);
+        
+        auto players = PlayerFactory::createPlayers(0, static_cast<int>(kBots), seed);
+        std::vector<Player*> members;
+        for (const auto& player : players) {
+            player->reserveHistory(kWarmup + kAttempts);
+            members.push_back(player.get());
+        }
+        Group large(members);
+        Group small(std::vector<Player*>(members.begin(), members.begin() + kSmall));
+        
+        auto play = [&](uint32_t attempt) {
+            uint32_t group = attempt % 2;
+            manager.executeRound(group ? small : large, {seed, attempt, group, 0, 0});
+        };
+        
+        for (uint32_t attempt = 0; attempt < kWarmup; ++attempt) {
+            play(attempt);
+        }
+        size_t before = AllocationCounter::count();
+        for (uint32_t attempt = kWarmup; attempt < kWarmup + kAttempts; ++attempt) {
+            play(attempt);
+        }
+        size_t allocations = AllocationCounter::count() - before;
+        
+        std::cout << "    Раунды ботов (" << policy << ", группы " << kBots << " и " << kSmall
+                  << "): " << allocations << " выделений на " << kAttempts << " попыток\n";
+        return allocations == 0;
+    }
+    
+    // Полные раунды тихого турнира ботов: первые раунды прогревают буферы
+    // Game, GroupDivider и RoundManager, дальше состав только сокращается
+    static bool checkGame(uint64_t seed) {
+        constexpr int kBots = 4000;
+        constexpr int kWarmup = 2;
+        constexpr int kRounds = 6;
+        constexpr size_t kHistory = 1024;  // ходов на игрока с переигровками
+        
+        GameOptions options = GameOptions{}.headless(1);
+        options.seed = seed;
+        options.groupSize = 4;
+        auto players = PlayerFactory::createPlayers(0, kBots, seed);
+        for (const auto& player : players) {
+            player->reserveHistory(kHistory);
         }
+        Game game(options, std::move(players));
+        
+        game.advance(kWarmup);
+        size_t before = AllocationCounter::count();
+        game.advance(kRounds);
+        size_t allocations = AllocationCounter::count() - before;
+        int played = game.rounds() - kWarmup;
+        
+        std::cout << "    Раунды Game (" << kBots << " ботов, группы по " << options.groupSize
+                  << "): " << allocations << " выделений на " << played << " раундов\n";
+        return allocations == 0 && played == kRounds;
+    }
+};
 
-        auto sortedScores = scores;
-        std::sort(sortedScores.begin(), sortedScores.end(),
-            [](const PlayerScore& a, const PlayerScore& b) {
-                if (a.getNetScore() != b.getNetScore()) {
-                    return a.getNetScore() > b.getNetScore();
+
+// Эволюционный подбор ботов: генетический алгоритм с элитизмом.
+// Геном - доли стратегий в команде и параметры стратегий. Приспособленность -
+// средняя доля раундов, которые продержались боты команды в тихих турнирах
+// против поля стандартных ботов. Все геномы поколения играют на одних и тех же
+// турнирах (поле и зерно общие), чтобы сравнение не тонуло в шуме.
+class Evolution {
+public:
+    struct Genome {
+        std::array<float, PlayerFactory::kNumStrategies> mix{};
+        BiasedStrategy::Weights biasedWeights = BiasedStrategy::kDefaultWeights;
+        float exp3Gamma = 0.1f;
+        float ucbExploration = 2.0f;
+        float metaDecay = 0.8f;
+        double fitness = 0.0;
+        
+        // Вид стратегии очередного бота команды - рулетка по долям mix
+        uint32_t pickKind(CounterRng& rng) const {
+            float total = 0.0f;
+            for (float share : mix) {
+                total += share;
+            }
+            float u = rng.uniform() * total;
+            for (uint32_t k = 0; k + 1 < mix.size(); ++k) {
+                u -= mix[k];
+                if (u < 0.0f) {
+                    return k;
                 }
-                return a.wins > b.wins;
-            });
+            }
+            return static_cast<uint32_t>(mix.size() - 1);
+        }
         
-        for (const auto& score : sortedScores) {
-            std::string balanceStr;
-            int net = score.getNetScore();
-            if (net > 0) balanceStr = "+" + std::to_string(net);
-            else balanceStr = std::to_string(net);
+        std::unique_ptr<ChoiceStrategy> createStrategy(uint32_t kind) const {
+            switch (kind) {
+                case 1: return std::make_unique<BiasedStrategy>(biasedWeights);
+                case 5: return std::make_unique<MetaStrategy>(metaDecay);
+                case 6: return std::make_unique<Ucb1Strategy>(ucbExploration);
+                case 7: return std::make_unique<Exp3Strategy>(exp3Gamma);
+                default: return PlayerFactory::createStrategy(kind);
+            }
+        }
+        
+        std::string describe() const {
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(3) << "приспособленность " << fitness << "\n";
+            for (uint32_t k = 0; k < mix.size(); ++k) {
+                out << "  " << PlayerFactory::createStrategy(k)->getName() << ": " << mix[k] << "\n";
+            }
+            out << "  веса взвешенной:";
+            for (uint32_t w : biasedWeights) {
+                out << " " << w;
+            }
+            out << "\n  gamma Exp3: " << exp3Gamma
+                << "\n  исследование UCB1: " << ucbExploration
+                << "\n  затухание мета-ансамбля: " << metaDecay << "\n";
+            return out.str();
+        }
+    };
+    
+    explicit Evolution(const GameOptions& options)
+        : options_(options), settings_(options.evolution) {}
+    
+    void run() {
+        std::cout << "\n  Эволюция ботов: зерно " << options_.seed
+                  << ", поколений " << settings_.generations
+                  << ", популяция " << settings_.population
+                  << ", турниров на геном " << settings_.tournaments
+                  << ", команда " << settings_.team << " против " << settings_.field
+                  << ", потоков " << options_.threads << "\n" << std::flush;
+        
+        // Нулевой геном - стандартная раздача, точка отсчёта
+        std::vector<Genome> population(settings_.population);
+        CounterRng seedRng(operatorKey(0));
+        population[0].mix.fill(1.0f / PlayerFactory::kNumStrategies);
+        for (size_t i = 1; i < population.size(); ++i) {
+            population[i] = randomGenome(seedRng);
+        }
+        
+        size_t played = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t generation = 0; ; ++generation) {
+            auto generationStart = std::chrono::steady_clock::now();
+            evaluate(population, generation);
+            played += population.size() * settings_.tournaments;
+            std::stable_sort(population.begin(), population.end(),
+                             [](const Genome& a, const Genome& b) { return a.fitness > b.fitness; });
             
-            std::cout << "    " << score.player->getName() 
-                      << " -- " << score.wins << "W/" << score.losses << "L"
-                      << " (баланс: " << balanceStr << ")\n";
+            double mean = 0.0;
+            for (const auto& genome : population) {
+                mean += genome.fitness;
+            }
+            mean /= population.size();
+            double seconds = secondsSince(generationStart);
+            std::cout << "  Поколение " << (generation + 1) << ": лучший " << std::fixed
+                      << std::setprecision(3) << population[0].fitness << ", средний " << mean
+                      << ", " << std::setprecision(1)
+                      << population.size() * settings_.tournaments / std::max(seconds, 1e-9)
+                      << " турниров/с\n" << std::flush;
+            
+            if (generation + 1 == settings_.generations) {
+                break;
+            }
+            breed(population, generation + 1);
+        }
+        
+        double seconds = secondsSince(start);
+        std::cout << "\n  Сыграно турниров: " << played << " за " << std::setprecision(2)
+                  << seconds << " с (" << std::setprecision(1)
+                  << played / std::max(seconds, 1e-9) << " турниров/с)\n";
+        
+        writeBest(population);
+        std::cout << "  Лучшие геномы записаны в " << settings_.out << "\n";
+    }
+    
+private:
+    static constexpr float kMutationScale = 0.1f;
+    static constexpr uint32_t kMaxWeight = 9;
+    
+    GameOptions options_;
+    EvolutionSettings settings_;
+    
+    // Поток операторов отбора/скрещивания/мутации поколения
+    DrawKey operatorKey(uint32_t generation) const {
+        return {options_.seed, generation, DrawKey::kService, DrawKey::kService, 0};
+    }
+    
+    static double secondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    
+    // Треугольный шум в (-scale, scale)
+    static float noise(CounterRng& rng, float scale) {
+        return scale * (rng.uniform() + rng.uniform() - 1.0f);
+    }
+    
+    static void normalize(Genome& genome) {
+        float total = 0.0f;
+        for (float& share : genome.mix) {
+            share = std::max(share, 0.0f);
+            total += share;
+        }
+        for (float& share : genome.mix) {
+            share = total > 0.0f ? share / total : 1.0f / genome.mix.size();
+        }
+        if (std::all_of(genome.biasedWeights.begin(), genome.biasedWeights.end(),
+                        [](uint32_t w) { return w == 0; })) {
+            genome.biasedWeights[0] = 1;
+        }
+    }
+    
+    static Genome randomGenome(CounterRng& rng) {
+        Genome genome;
+        for (float& share : genome.mix) {
+            share = rng.uniform();
+        }
+        for (uint32_t& w : genome.biasedWeights) {
+            w = rng.below(kMaxWeight + 1);
         }
+        genome.exp3Gamma = 0.01f + 0.49f * rng.uniform();
+        genome.ucbExploration = 0.1f + 7.9f * rng.uniform();
+        genome.metaDecay = 0.5f + 0.49f * rng.uniform();
+        normalize(genome);
+        return genome;
     }
     
-    std::vector<Player*> determineLosers(std::vector<PlayerScore>& scores,
-                                          const std::string& groupName) {
-        // Находим минимальный и максимальный баланс
-        int minNetScore = scores[0].getNetScore();
-        int maxNetScore = scores[0].getNetScore();
-        for (const auto& score : scores) {
-            if (score.getNetScore() < minNetScore) {
-                minNetScore = score.getNetScore();
+    // Равномерное скрещивание по генам и мутация
+    static Genome offspring(const Genome& a, const Genome& b, CounterRng& rng) {
+        Genome child;
+        for (size_t k = 0; k < child.mix.size(); ++k) {
+            child.mix[k] = (rng() & 1 ? a : b).mix[k] + noise(rng, kMutationScale);
+        }
+        for (size_t c = 0; c < child.biasedWeights.size(); ++c) {
+            uint32_t w = (rng() & 1 ? a : b).biasedWeights[c];
+            uint32_t roll = rng.below(10);
+            if (roll == 0 && w > 0) {
+                w--;
+            } else if (roll == 1 && w < kMaxWeight) {
+                w++;
+            }
+            child.biasedWeights[c] = w;
+        }
+        child.exp3Gamma = std::clamp((rng() & 1 ? a : b).exp3Gamma + noise(rng, 0.05f), 0.01f, 0.5f);
+        child.ucbExploration = std::clamp((rng() & 1 ? a : b).ucbExploration + noise(rng, 0.5f), 0.1f, 8.0f);
+        child.metaDecay = std::clamp((rng() & 1 ? a : b).metaDecay + noise(rng, 0.05f), 0.5f, 0.99f);
+        normalize(child);
+        return child;
+    }
+    
+    // Лучшая половина переходит как есть, остальные - потомки двух
+    // случайных родителей из неё
+    void breed(std::vector<Genome>& population, uint32_t generation) const {
+        CounterRng rng(operatorKey(generation));
+        uint32_t elite = static_cast<uint32_t>((population.size() + 1) / 2);
+        for (size_t i = elite; i < population.size(); ++i) {
+            population[i] = offspring(population[rng.below(elite)],
+                                      population[rng.below(elite)], rng);
+        }
+    }
+    
+    // Турниры разной длины, поэтому потоки берут их из общей очереди
+    void evaluate(std::vector<Genome>& population, uint32_t generation) const {
+        size_t perGenome = settings_.tournaments;
+        std::vector<double> results(population.size() * perGenome);
+        std::atomic<size_t> next{0};
+        auto worker = [&]() {
+            for (size_t task; (task = next.fetch_add(1)) < results.size(); ) {
+                results[task] = playTournament(population[task / perGenome], generation,
+                                               static_cast<uint32_t>(task % perGenome));
+                Metrics::add(Metrics::TOURNAMENTS);
+            }
+        };
+        
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < std::min<size_t>(options_.threads, results.size()); ++t) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
+        }
+        
+        for (size_t i = 0; i < population.size(); ++i) {
+            double sum = 0.0;
+            for (size_t t = 0; t < perGenome; ++t) {
+                sum += results[i * perGenome + t];
+            }
+            population[i].fitness = sum / perGenome;
+        }
+    }
+    
+    // Игроки создаются напрямую, без счётчиков PlayerFactory: турниры идут
+    // на нескольких потоках одновременно
+    double playTournament(const Genome& genome, uint32_t generation, uint32_t tournament) const {
+        CounterRng rng({options_.seed, generation, tournament, DrawKey::kService, 0,
+                        DrawKey::EVOLUTION});
+        
+        std::vector<std::unique_ptr<Player>> players;
+        uint32_t id = 0;
+        for (size_t i = 0; i < settings_.field; ++i, ++id) {
+            players.push_back(std::make_unique<ComputerPlayer>(
+                id, "Бот " + std::to_string(i + 1),
+                PlayerFactory::createStrategy(rng.below(PlayerFactory::kNumStrategies))));
+        }
+        
+        GameOptions options = options_.headless(1);
+        options.seed = (uint64_t{rng()} << 32) | rng();
+        
+        for (size_t i = 0; i < settings_.team; ++i, ++id) {
+            players.push_back(std::make_unique<ComputerPlayer>(
+                id, "Геном " + std::to_string(i + 1), genome.createStrategy(genome.pickKind(rng))));
+        }
+        
+        Game game(options, std::move(players));
+        game.run();
+        
+        // Победитель продержался все раунды, выбывший в раунде r - r-1 из них
+        double rounds = game.rounds();
+        double survival = 0.0;
+        for (size_t slot = settings_.field; slot < game.numPlayers(); ++slot) {
+            const Player& player = game.player(slot);
+            survival += player.isActive() ? 1.0 : (player.getEliminatedRound() - 1) / rounds;
+        }
+        return survival / settings_.team;
+    }
+    
+    void writeBest(const std::vector<Genome>& population) const {
+        std::ofstream out(settings_.out);
+        if (!out) {
+            throw std::runtime_error("не удалось открыть " + settings_.out);
+        }
+        out << "# rpsls --evolve, зерно " << options_.seed << "\n";
+        size_t count = std::min<size_t>(population.size(), 5);
+        for (size_t i = 0; i < count; ++i) {
+            out << "\nГеном " << (i + 1) << ": " << population[i].describe();
+        }
+    }
+};
+
+
+// Репликаторная динамика долей видов стратегий в бесконечной (или большой)
+// популяции. Вид задаётся распределением выборов p_i, выигрыш вида против
+// вида - p_i^T M p_j, где M[a][b] = GameRules::payoff(a, b). Матрица видов
+// K x K имеет ранг не больше 5, поэтому приспособленность считается через
+// смесь выборов популяции: f = P (M (P^T x)) - шаг O(K), а не O(K^2).
+// Дискретный шаг x_i *= 1 + dt (f_i - f_avg) сохраняет положительность
+// при dt <= 0.5, так как |f_i - f_avg| <= 2.
+class ReplicatorDynamics {
+public:
+    using Distribution = std::array<float, ChoiceHelper::kCount>;
+    
+    ReplicatorDynamics(const std::vector<Distribution>& types, std::vector<std::string> names,
+                       double dt, size_t population)
+        : names_(std::move(names)),
+          size_(types.size()),
+          dt_(static_cast<float>(dt)),
+          population_(population),
+          shares_(types.size(), 1.0f / types.size()) {
+        for (size_t c = 0; c < ChoiceHelper::kCount; ++c) {
+            columns_[c].resize(size_);
+            for (size_t i = 0; i < size_; ++i) {
+                columns_[c][i] = types[i][c];
+            }
+            for (size_t d = 0; d < ChoiceHelper::kCount; ++d) {
+                payoff_[c][d] = static_cast<float>(
+                    GameRules::payoff(static_cast<Choice>(c), static_cast<Choice>(d)));
+            }
+        }
+    }
+    
+    // Встроенные виды (чистые выборы, случайная, взвешенная) и
+    // случайные смешанные стратегии до общего числа count
+    static ReplicatorDynamics fromSettings(const ReplicatorSettings& settings, uint64_t seed) {
+        std::vector<Distribution> types;
+        std::vector<std::string> names;
+        for (Choice choice : ChoiceHelper::allChoices()) {
+            Distribution pure{};
+            pure[ChoiceHelper::index(choice)] = 1.0f;
+            types.push_back(pure);
+            names.push_back(ChoiceHelper::toString(choice));
+        }
+        Distribution uniform;
+        uniform.fill(1.0f / ChoiceHelper::kCount);
+        types.push_back(uniform);
+        names.push_back(RandomStrategy().getName());
+        
+        Distribution biased{};
+        float total = 0.0f;
+        for (uint32_t w : BiasedStrategy::kDefaultWeights) {
+            total += static_cast<float>(w);
+        }
+        for (size_t c = 0; c < ChoiceHelper::kCount; ++c) {
+            biased[c] = BiasedStrategy::kDefaultWeights[c] / total;
+        }
+        types.push_back(biased);
+        names.push_back(BiasedStrategy().getName());
+        
+        // Равномерно по симплексу: нормированные экспоненциальные величины
+        CounterRng rng({seed, 0, DrawKey::kService, DrawKey::kService, 0, DrawKey::REPLICATOR_INIT});
+        while (types.size() < settings.types) {
+            Distribution mixed;
+            float sum = 0.0f;
+            for (float& p : mixed) {
+                p = -std::log(1.0f - rng.uniform());
+                sum += p;
+            }
+            for (float& p : mixed) {
+                p /= sum;
+            }
+            types.push_back(mixed);
+            names.push_back("Смешанная " + std::to_string(types.size() - 7));
+        }
+        return ReplicatorDynamics(types, std::move(names), settings.dt, settings.population);
+    }
+    
+    void run(size_t steps, size_t report, uint64_t seed) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < steps; ++t) {
+            step(seed, t);
+            if (report > 0 && (t + 1) % report == 0) {
+                std::cout << "\n  Шаг " << (t + 1) << ":\n";
+                printTop(5);
+            }
+        }
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        
+        std::cout << "\n  Итог после " << steps << " шагов (" << std::fixed << std::setprecision(0)
+                  << steps / std::max(seconds, 1e-9) << " шагов/с):\n";
+        printTop(10);
+        
+        Distribution mix = populationMix();
+        std::cout << "  Смесь выборов популяции:";
+        for (Choice choice : ChoiceHelper::allChoices()) {
+            std::cout << " " << ChoiceHelper::toString(choice) << " " << std::setprecision(3)
+                      << mix[ChoiceHelper::index(choice)];
+        }
+        std::cout << "\n";
+    }
+    
+    const std::vector<float>& shares() const { return shares_; }
+    
+private:
+    static constexpr size_t kLanes = 8;
+    
+    std::vector<std::string> names_;
+    size_t size_;
+    float dt_;
+    size_t population_;
+    std::vector<float> shares_;
+    std::array<std::vector<float>, ChoiceHelper::kCount> columns_;  // P по столбцам выборов
+    std::array<Distribution, ChoiceHelper::kCount> payoff_{};
+    
+    // P^T x: вероятность каждого выбора в популяции. Суммы по kLanes
+    // независимым дорожкам, чтобы редукция векторизовалась без -ffast-math
+    Distribution populationMix() const {
+        Distribution mix{};
+        for (size_t c = 0; c < ChoiceHelper::kCount; ++c) {
+            const float* column = columns_[c].data();
+            float lanes[kLanes] = {};
+            size_t i = 0;
+            for (; i + kLanes <= size_; i += kLanes) {
+                for (size_t l = 0; l < kLanes; ++l) {
+                    lanes[l] += column[i + l] * shares_[i + l];
+                }
+            }
+            for (; i < size_; ++i) {
+                lanes[0] += column[i] * shares_[i];
             }
-            if (score.getNetScore() > maxNetScore) {
-                maxNetScore = score.getNetScore();
+            for (float lane : lanes) {
+                mix[c] += lane;
             }
         }
+        return mix;
+    }
+    
+    void step(uint64_t seed, size_t t) {
+        Distribution mix = populationMix();
         
-        // Если у всех одинаковый баланс - ничья, переигровка
-        if (minNetScore == maxNetScore) {
-            if (!groupName.empty()) {
-                std::cout << "\n  [" << groupName << "] Ничья! Переигровка...\n";
-            } else {
-                std::cout << "\n  Ничья! Переигровка...\n";
+        // Выигрыш каждого выбора против смеси и средний выигрыш популяции
+        // (для антисимметричной M он равен нулю, но считается честно)
+        Distribution gain{};
+        float average = 0.0f;
+        for (size_t c = 0; c < ChoiceHelper::kCount; ++c) {
+            for (size_t d = 0; d < ChoiceHelper::kCount; ++d) {
+                gain[c] += payoff_[c][d] * mix[d];
             }
-            return {}; // Пустой список = переигровка
+            average += mix[c] * gain[c];
         }
         
-        // Собираем проигравших
-        std::vector<Player*> losers;
-        for (const auto& score : scores) {
-            if (score.getNetScore() == minNetScore) {
-                losers.push_back(score.player);
-                if (!groupName.empty()) {
-                    std::cout << "\n  [" << groupName << "] " << score.player->getName() 
-                              << " выбывает! (" << score.wins << "W/" << score.losses << "L)\n";
-                } else {
-                    std::cout << "\n  " << score.player->getName() 
-                              << " выбывает! (" << score.wins << "W/" << score.losses << "L)\n";
+        float lanes[kLanes] = {};
+        float* x = shares_.data();
+        for (size_t base = 0; base < size_; base += kLanes) {
+            size_t count = std::min(kLanes, size_ - base);
+            for (size_t l = 0; l < count; ++l) {
+                size_t i = base + l;
+                float fitness = 0.0f;
+                for (size_t c = 0; c < ChoiceHelper::kCount; ++c) {
+                    fitness += columns_[c][i] * gain[c];
                 }
+                x[i] *= 1.0f + dt_ * (fitness - average);
+                lanes[l] += x[i];
             }
         }
         
-        return losers;
+        if (population_ > 0) {
+            addDrift(seed, t);
+        }
+        
+        float total = 0.0f;
+        if (population_ > 0) {
+            for (size_t i = 0; i < size_; ++i) {
+                total += x[i];
+            }
+        } else {
+            for (float lane : lanes) {
+                total += lane;
+            }
+        }
+        float scale = 1.0f / total;
+        for (size_t i = 0; i < size_; ++i) {
+            x[i] *= scale;
+        }
+    }
+    
+    // Шум конечной популяции N (диффузионное приближение Райта-Фишера):
+    // x_i += sqrt(x_i dt / N) * N(0, 1). Вымерший вид не возвращается.
+    void addDrift(uint64_t seed, size_t t) {
+        // Старшие биты шага - в поле переигровки, тег потока отдельно
+        CounterRng rng({seed, static_cast<uint32_t>(t), DrawKey::kService, DrawKey::kService,
+                        static_cast<uint32_t>(uint64_t{t} >> 32), DrawKey::REPLICATOR_DRIFT});
+        float variance = dt_ / static_cast<float>(population_);
+        for (size_t i = 0; i < size_; i += 2) {
+            // Бокс-Мюллер: два нормальных числа из двух равномерных
+            float radius = std::sqrt(-2.0f * std::log(1.0f - rng.uniform()));
+            float angle = 6.2831853f * rng.uniform();
+            float normals[2] = {radius * std::cos(angle), radius * std::sin(angle)};
+            for (size_t k = 0; k < 2 && i + k < size_; ++k) {
+                float& x = shares_[i + k];
+                x = std::max(0.0f, x + std::sqrt(x * variance) * normals[k]);
+            }
+        }
+    }
+    
+    void printTop(size_t count) const {
+        std::vector<size_t> order(size_);
+        for (size_t i = 0; i < size_; ++i) {
+            order[i] = i;
+        }
+        count = std::min(count, size_);
+        std::partial_sort(order.begin(), order.begin() + count, order.end(),
+                          [this](size_t a, size_t b) { return shares_[a] > shares_[b]; });
+        for (size_t k = 0; k < count; ++k) {
+            std::cout << "    " << padRight(names_[order[k]], 20) << std::fixed << std::setprecision(4) << shares_[order[k]] << "\n";
+        }
     }
 };
 
 
-// Класс для разделения на группы
-class GroupDivider {
-private:
-    std::mt19937 rng_;
-    
+// Замер --bench: тихие турниры без людей для всех сочетаний потоков,
+// размеров состава и групп. Зерно общее, поэтому при разном числе потоков
+// играется один и тот же турнир и время сравнимо напрямую. Эффективность
+// считается от наименьшего числа потоков того же состава и групп.
+// Группы играются по очереди, а потоки делят работу только внутри группы
+// от RoundManager::kParallelGroup игроков. Составы, где такой группы не
+// бывает, играются один раз на одном потоке, без эффективности: иначе
+// она выходила бы около 1/T и мерила бы простой, а не масштабирование.
+class ScalingBench {
 public:
-    GroupDivider() : rng_(std::random_device{}()) {}
-    
-    // Разделяет игроков на группы по 2-4 человека
-    // Ни один игрок не должен остаться без группы
-    std::vector<std::vector<Player*>> divideIntoGroups(std::vector<Player*>& players) {
-        std::vector<std::vector<Player*>> groups;
-        
-        // Перемешиваем игроков
-        std::vector<Player*> shuffled = players;
-        std::shuffle(shuffled.begin(), shuffled.end(), rng_);
-        
-        int n = static_cast<int>(shuffled.size());
-        
-        // Алгоритм разбиения:
-        // - Стараемся набрать группы по 4
-        // - Если остаток 1, то заменяем одну четвёрку на 3+2
-        // - Если остаток 2, добавляем группу из 2
-        // - Если остаток 3, добавляем группу из 3
-        
-        int numFours = n / 4;
-        int remainder = n % 4;
-        
-        std::vector<int> groupSizes;
-        
-        if (remainder == 0) {
-            // Все группы по 4
-            for (int i = 0; i < numFours; ++i) {
-                groupSizes.push_back(4);
-            }
-        } else if (remainder == 1) {
-            // (numFours-1) групп по 4, затем 3 и 2
-            for (int i = 0; i < numFours - 1; ++i) {
-                groupSizes.push_back(4);
+    explicit ScalingBench(const GameOptions& options)
+        : options_(options), settings_(options.bench) {
+        if (settings_.threads.empty()) {
+            unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+            for (size_t t = 1; t < cores; t *= 2) {
+                settings_.threads.push_back(t);
             }
-            groupSizes.push_back(3);
-            groupSizes.push_back(2);
-        } else if (remainder == 2) {
-            // numFours групп по 4, затем 2
-            for (int i = 0; i < numFours; ++i) {
-                groupSizes.push_back(4);
+            settings_.threads.push_back(cores);
+        }
+        std::sort(settings_.threads.begin(), settings_.threads.end());
+        if (settings_.pages.empty()) {
+            settings_.pages.push_back(options.hugePages);
+        }
+        if (settings_.packed.empty()) {
+            settings_.packed.push_back(options.groupLayout);
+        }
+        if (settings_.prefetch.empty()) {
+            settings_.prefetch.push_back(options.prefetch);
+        }
+    }
+    
+    void run() {
+        std::ofstream file;
+        if (!settings_.out.empty()) {
+            file.open(settings_.out);
+            if (!file) {
+                throw std::runtime_error("не удалось открыть " + settings_.out);
             }
-            groupSizes.push_back(2);
-        } else { // remainder == 3
-            // numFours групп по 4, затем 3
-            for (int i = 0; i < numFours; ++i) {
-                groupSizes.push_back(4);
+        }
+        std::ostream& out = settings_.out.empty() ? std::cout : file;
+        const std::vector<size_t> single{1};
+        size_t configs = 0;
+        size_t parallel = 0;
+        for (size_t players : settings_.players) {
+            for (size_t group : settings_.groups) {
+                configs += threaded(players, group) ? settings_.threads.size() : 1;
+                parallel += threaded(players, group);
             }
-            groupSizes.push_back(3);
+        }
+        std::cerr << "\n  Замер масштабирования: зерно " << options_.seed << ", "
+                  << configs * settings_.pages.size() * settings_.packed.size() *
+                     settings_.prefetch.size()
+                  << " турниров\n";
+        if (parallel == 0 && settings_.threads.size() > 1) {
+            std::cerr << "  Ни в одном составе нет группы от " << RoundManager::kParallelGroup
+                      << " игроков - потоки не перебираются (нужны groups=0 или большие группы)\n";
         }
         
-        // Создаём группы
-        size_t idx = 0;
-        for (int size : groupSizes) {
-            std::vector<Player*> group;
-            for (int i = 0; i < size && idx < shuffled.size(); ++i) {
-                group.push_back(shuffled[idx++]);
+        if (settings_.json) {
+            out << "[";
+        } else {
+            out << "threads,players,group_size,pages,layout,prefetch,rounds,moves,seconds,moves_per_second,"
+                   "efficiency,peak_rss_mb,huge_mb,dtlb_misses,p50_round_ms,p99_round_ms\n";
+        }
+        bool first = true;
+        for (size_t players : settings_.players) {
+            for (size_t group : settings_.groups) {
+                for (HugePages::Mode pages : settings_.pages) {
+                    for (bool packed : settings_.packed) {
+                        for (size_t prefetch : settings_.prefetch) {
+                            bool scales = threaded(players, group);
+                            double baseline = 0.0;
+                            for (size_t threads : scales ? settings_.threads : single) {
+                                Sample sample = measure(players, group, pages, packed, prefetch, threads);
+                                if (baseline == 0.0) {
+                                    baseline = sample.seconds * threads;
+                                }
+                                sample.efficiency = scales ? baseline / (sample.seconds * threads) : -1.0;
+                                write(out, sample, first);
+                                first = false;
+                                std::cerr << "    потоков " << threads << ", игроков " << players
+                                          << ", группа " << group << ", страницы "
+                                          << HugePages::name(pages) << ", " << layoutName(packed)
+                                          << ", подкачка " << prefetch << ": " << std::fixed
+                                          << std::setprecision(3) << sample.seconds << " с\n";
+                            }
+                        }
+                    }
+                }
             }
-            groups.push_back(group);
         }
-        
-        return groups;
+        if (HugePages::explicitFallbacks() > 0) {
+            std::cerr << "  MAP_HUGETLB не дал страниц " << HugePages::explicitFallbacks()
+                      << " раз, взяты прозрачные (vm.nr_hugepages)\n";
+        }
+        HugePages::setMode(options_.hugePages);
+        if (settings_.json) {
+            out << "\n]\n";
+        }
     }
-};
-
-
-class Game {
+    
 private:
-    std::vector<std::unique_ptr<Player>> players_;
-    std::unique_ptr<RoundManager> roundManager_;
-    std::unique_ptr<GroupDivider> groupDivider_;
-    int roundNumber_ = 0;
+    struct Sample {
+        size_t threads, players, group;
+        HugePages::Mode pages;
+        bool packed;
+        size_t prefetch;
+        int rounds;
+        uint64_t moves;
+        double seconds;
+        double efficiency;   // -1 - потоки на этом составе не работают
+        double peakRssMb;
+        double hugeMb;
+        int64_t dtlbMisses;  // -1 - счётчик недоступен
+        double p50Ms, p99Ms;
+    };
     
-    std::vector<Player*> getActivePlayers() {
-        std::vector<Player*> active;
-        for (auto& player : players_) {
-            if (player->isActive()) {
-                active.push_back(player.get());
-            }
+    static const char* layoutName(bool packed) { return packed ? "packed" : "pointer"; }
+    
+    // Эффективность с тремя знаками; missing - если потоки не перебирались
+    static std::string efficiencyText(const Sample& s, const char* missing) {
+        if (s.efficiency < 0) {
+            return missing;
         }
-        return active;
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(3) << s.efficiency;
+        return text.str();
     }
     
-    int readInt(const std::string& prompt) {
-        while (true) {
-            std::cout << prompt << std::flush;
-            std::string input;
-            std::getline(std::cin, input);
-            
-            try {
-                return std::stoi(input);
-            } catch (...) {
-                std::cout << "  Введите целое число!\n";
+    // Бывает ли в турнире группа, которую движок делит между потоками.
+    // Состав только сокращается, так что достаточно первого раунда.
+    static bool threaded(size_t players, size_t group) {
+        bool grouped = group > 0 && players > group + 1;
+        size_t largest = grouped ? std::max<size_t>(group, 3) : players;
+        return largest >= RoundManager::kParallelGroup;
+    }
+    
+    Sample measure(size_t players, size_t group, HugePages::Mode pages, bool packed, size_t prefetch,
+                   size_t threads) {
+        GameOptions options = options_.headless(static_cast<unsigned>(threads));
+        options.groupSize = group;
+        options.groupLayout = packed;
+        options.prefetch = prefetch;
+        
+        HugePages::setMode(pages);
+        resetPeakRss();
+        auto roster = PlayerFactory::createPlayers(0, static_cast<int>(players), options.seed);
+        Game game(options, std::move(roster));
+        std::vector<int> dtlb;
+#ifdef RPSLS_HAVE_PERF_EVENTS
+        dtlb = PhaseProfiler::openCounter(PERF_TYPE_HW_CACHE, PhaseProfiler::kDtlbReadMiss,
+                                          options.threads);
+#endif
+        uint64_t dtlbBefore = 0;
+        bool counted = PhaseProfiler::readCounter(dtlb, dtlbBefore);
+        auto start = std::chrono::steady_clock::now();
+        game.run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t dtlbAfter = 0;
+        counted = PhaseProfiler::readCounter(dtlb, dtlbAfter) && counted;
+        PhaseProfiler::closeCounter(dtlb);
+        double hugeMb = hugePagesMb();
+        
+        uint64_t moves = 0;
+        for (size_t slot = 0; slot < game.numPlayers(); ++slot) {
+            moves += game.player(slot).getMoveCount();
+        }
+        std::vector<double> latencies = game.roundSeconds();
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            if (latencies.empty()) {
+                return 0.0;
             }
+            size_t rank = static_cast<size_t>(std::ceil(p * latencies.size()));
+            return latencies[std::max<size_t>(rank, 1) - 1] * 1e3;
+        };
+        return {threads, players, group, pages, packed, prefetch, game.rounds(), moves, seconds, 1.0, peakRssMb(),
+                hugeMb, counted ? static_cast<int64_t>(dtlbAfter - dtlbBefore) : -1,
+                percentile(0.5), percentile(0.99)};
+    }
+    
+    void write(std::ostream& out, const Sample& s, bool first) const {
+        double rate = s.moves / std::max(s.seconds, 1e-9);
+        out << std::fixed;
+        if (settings_.json) {
+            out << (first ? "\n" : ",\n") << "  {\"threads\": " << s.threads
+                << ", \"players\": " << s.players << ", \"group_size\": " << s.group
+                << ", \"pages\": \"" << HugePages::name(s.pages) << "\""
+                << ", \"layout\": \"" << layoutName(s.packed) << "\""
+                << ", \"prefetch\": " << s.prefetch
+                << ", \"rounds\": " << s.rounds << ", \"moves\": " << s.moves
+                << std::setprecision(6) << ", \"seconds\": " << s.seconds
+                << std::setprecision(0) << ", \"moves_per_second\": " << rate
+                << ", \"efficiency\": "
+                << efficiencyText(s, "null")
+                << std::setprecision(1) << ", \"peak_rss_mb\": " << s.peakRssMb
+                << ", \"huge_mb\": " << s.hugeMb << ", \"dtlb_misses\": "
+                << (s.dtlbMisses < 0 ? "null" : std::to_string(s.dtlbMisses))
+                << std::setprecision(3) << ", \"p50_round_ms\": " << s.p50Ms
+                << ", \"p99_round_ms\": " << s.p99Ms << "}";
+        } else {
+            out << s.threads << "," << s.players << "," << s.group << "," << HugePages::name(s.pages)
+                << "," << layoutName(s.packed) << "," << s.prefetch << "," << s.rounds << "," << s.moves << "," << std::setprecision(6) << s.seconds << ","
+                << std::setprecision(0) << rate << ","
+                << efficiencyText(s, "") << ","
+                << std::setprecision(1) << s.peakRssMb << "," << s.hugeMb << ","
+                << (s.dtlbMisses < 0 ? "" : std::to_string(s.dtlbMisses)) << ","
+                << std::setprecision(3) << s.p50Ms
+                << "," << s.p99Ms << "\n";
         }
+        out << std::flush;
     }
     
-    // Проводит раунд в одной группе с переигровками до победителя
-    void playGroupRound(std::vector<Player*>& group, const std::string& groupName) {
-        while (true) {
-            std::vector<Player*> losers = roundManager_->executeRound(group, groupName);
-            
-            if (losers.empty()) {
-                // Ничья - переигровка
-                continue;
-            }
-            
-            // Деактивируем проигравших
-            for (auto* loser : losers) {
-                loser->setActive(false);
+    // Пик RSS сбрасывается перед каждым турниром (clear_refs 5, Linux 4.0+);
+    // если сброс недоступен, VmHWM - пик всего процесса до этого момента
+    static void resetPeakRss() {
+        std::ofstream clear("/proc/self/clear_refs");
+        clear << "5" << std::flush;
+    }
+    
+    static double peakRssMb() {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) {
+                return std::stod(line.substr(6)) / 1024.0;
             }
-            
-            // Убираем проигравших из группы
-            group.erase(
-                std::remove_if(group.begin(), group.end(),
-                    [](Player* p) { return !p->isActive(); }),
-                group.end()
-            );
-            
-            break; // Раунд завершён
         }
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss / 1024.0;
     }
     
-    // Проводит раунд для всех игроков (с разделением на группы если нужно)
-    void playRound(std::vector<Player*>& activePlayers) {
-        if (activePlayers.size() > 5) {
-            // Разделяем на группы
-            auto groups = groupDivider_->divideIntoGroups(activePlayers);
-            
-            std::cout << "\n  Игроков много (" << activePlayers.size() 
-                      << "), разделяем на " << groups.size() << " групп(ы):\n";
-            
-            for (size_t i = 0; i < groups.size(); ++i) {
-                std::cout << "    Группа " << (i + 1) << ": ";
-                for (size_t j = 0; j < groups[i].size(); ++j) {
-                    if (j > 0) std::cout << ", ";
-                    std::cout << groups[i][j]->getName();
-                }
-                std::cout << "\n";
-            }
-            
-            // Проводим раунд в каждой группе
-            for (size_t i = 0; i < groups.size(); ++i) {
-                std::string groupName = "Группа " + std::to_string(i + 1);
-                std::cout << "\n" << std::string(40, '-') << "\n";
-                playGroupRound(groups[i], groupName);
-            }
-            
-        } else {
-            // Играем все вместе с переигровками
-            while (true) {
-                std::vector<Player*> losers = roundManager_->executeRound(activePlayers);
-                
-                if (losers.empty()) {
-                    // Ничья - переигровка
-                    continue;
-                }
-                
-                // Деактивируем проигравших
-                for (auto* loser : losers) {
-                    loser->setActive(false);
-                }
-                
-                break;
+    // Сколько памяти процесса сейчас на больших страницах (THP и hugetlbfs)
+    static double hugePagesMb() {
+        std::ifstream rollup("/proc/self/smaps_rollup");
+        std::string line;
+        double kb = 0.0;
+        while (std::getline(rollup, line)) {
+            if (line.compare(0, 14, "AnonHugePages:") == 0) {
+                kb += std::stod(line.substr(14));
+            } else if (line.compare(0, 16, "Private_Hugetlb:") == 0) {
+                kb += std::stod(line.substr(16));
             }
         }
+        return kb / 1024.0;
     }
     
+    GameOptions options_;
+    BenchSettings settings_;
+};
+
+
+// Ветвление --what-if: турнир доигрывается до развилки, потом ветки
+// играются параллельно от общего состава. Ветка копирует только тех
+// игроков, которых меняет (активных после развилки), выбывшие остаются
+// общими. Ветки с вмешательством и без него идут на одних зёрнах, поэтому
+// разница между ними - эффект вмешательства, а не жеребьёвки.
+class WhatIf {
 public:
-    Game() : roundManager_(std::make_unique<RoundManager>()),
-             groupDivider_(std::make_unique<GroupDivider>()) {}
+    explicit WhatIf(const GameOptions& options) : options_(options), settings_(options.whatIf) {}
     
-    void setup() {
-        std::cout << "\n" << std::string(60, '=') << "\n";
-        std::cout << "  КАМЕНЬ-НОЖНИЦЫ-БУМАГА-ЯЩЕРИЦА-СПОК\n";
-        std::cout << "  Режим: Все против всех\n";
-        std::cout << "  Ave Deus Mechanicus!\n";
-        std::cout << std::string(60, '=') << "\n";
+    void run() {
+        GameOptions options = options_.headless(options_.threads);
+        if (options.groupLayout) {
+            throw std::invalid_argument("--what-if несовместим с --group-layout");
+        }
         
-        std::cout << "\n  Правила:\n";
-        std::cout << "  - Ножницы режут бумагу, бумага покрывает камень\n";
-        std::cout << "  - Камень давит ящерицу, ящерица отравляет Спока\n";
-        std::cout << "  - Спок ломает ножницы, ножницы обезглавливают ящерицу\n";
-        std::cout << "  - Ящерица съедает бумагу, на бумаге улики против Спока\n";
-        std::cout << "  - Спок испаряет камень, камень разбивает ножницы\n";
-        std::cout << "\n  Механика:\n";
-        std::cout << "  - Каждый раунд все делают выбор одновременно\n";
-        std::cout << "  - Игрок(и) с худшим балансом побед/поражений выбывают\n";
-        std::cout << "  - При ничьей - переигровка\n";
-        std::cout << "  - Если игроков > 5, они делятся на группы по 2-4\n";
-        std::cout << "  - Последний оставшийся - победитель!\n" << std::flush;
+        Game base(options, PlayerFactory::createPlayers(0, static_cast<int>(settings_.players),
+                                                         options.seed));
+        if (base.advance(settings_.round)) {
+            throw std::runtime_error("турнир закончился раньше раунда " +
+                                     std::to_string(settings_.round));
+        }
+        bool intervene = settings_.player != WhatIfSettings::kNoPlayer;
+        if (intervene && !base.player(settings_.player).isActive()) {
+            throw std::runtime_error(base.player(settings_.player).getName() + " уже выбыл");
+        }
         
-        int numHumans, numComputers;
+        size_t active = 0;
+        for (size_t slot = 0; slot < base.numPlayers(); ++slot) {
+            active += base.player(slot).isActive();
+        }
+        std::cout << "\n  Ветвление: зерно " << options.seed << ", игроков " << settings_.players
+                  << ", развилка после раунда " << settings_.round << " (активных " << active
+                  << "), веток " << settings_.branches << (intervene ? " x 2" : "")
+                  << ", потоков " << options.threads << "\n" << std::flush;
         
-        while (true) {
-            numHumans = readInt("\n  Количество игроков-людей: ");
-            if (numHumans < 0) {
-                std::cout << "  Число не может быть отрицательным!\n";
-                continue;
+        size_t variants = intervene ? 2 : 1;
+        std::vector<Outcome> outcomes(settings_.branches * variants);
+        size_t clonesBefore = CowRoster::clones();
+        auto start = std::chrono::steady_clock::now();
+        
+        std::atomic<size_t> next{0};
+        auto worker = [&]() {
+            for (size_t task; (task = next.fetch_add(1)) < outcomes.size(); ) {
+                outcomes[task] = playBranch(base, task / variants, task % variants == 1);
             }
-            break;
+        };
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < std::min<size_t>(options.threads, outcomes.size()); ++t) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
         }
         
-        while (true) {
-            numComputers = readInt("  Количество игроков-компьютеров: ");
-            if (numComputers < 0) {
-                std::cout << "  Число не может быть отрицательным!\n";
-                continue;
-            }
-            
-            int total = numHumans + numComputers;
-            if (total < 2) {
-                std::cout << "  Для игры нужно минимум 2 участника!\n";
-                continue;
-            }
-            
-            if (numHumans == 1 && numComputers == 0) {
-                std::cout << "  Один игрок не может играть сам с собой,\n";
-                std::cout << "  Добавьте хотя бы одного компьютера.\n";
-                continue;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double clones = static_cast<double>(CowRoster::clones() - clonesBefore) / outcomes.size();
+        std::cout << "  Сыграно веток: " << outcomes.size() << " за " << std::fixed
+                  << std::setprecision(2) << seconds << " с, скопировано игроков на ветку "
+                  << std::setprecision(1) << clones << " из " << settings_.players << "\n";
+        
+        if (!intervene) {
+            double rounds = 0.0;
+            for (const auto& outcome : outcomes) {
+                rounds += outcome.rounds;
             }
-            
-            break;
+            std::cout << "  Раундов в среднем: " << rounds / outcomes.size() << "\n";
+            return;
         }
         
-        std::cout << "\n";
-        players_ = PlayerFactory::createPlayers(numHumans, numComputers);
-        
-        std::cout << "\n  Участники турнира:\n";
-        int i = 1;
-        for (const auto& player : players_) {
-            std::cout << "    " << i++ << ". " << player->getName() 
-                      << " (" << player->getType() << ")\n";
+        const std::string& name = base.player(settings_.player).getName();
+        size_t sameWinner = 0;
+        for (size_t b = 0; b < settings_.branches; ++b) {
+            sameWinner += outcomes[2 * b].winner == outcomes[2 * b + 1].winner;
         }
+        printTarget("как есть", name, outcomes, 0);
+        printTarget(std::string("с ходом ") + ChoiceHelper::toString(settings_.choice), name, outcomes, 1);
+        std::cout << "  Победитель тот же в " << sameWinner << " из " << settings_.branches
+                  << " пар веток\n";
     }
     
-    void run() {
-        while (getActivePlayers().size() > 1) {
-            roundNumber_++;
-            auto activePlayers = getActivePlayers();
-            
-            std::cout << "\n" << std::string(60, '=') << "\n";
-            std::cout << "  РАУНД " << roundNumber_ << "\n";
-            std::cout << "  Осталось игроков: " << activePlayers.size() << "\n";
-            std::cout << std::string(60, '=') << "\n";
-            
-            playRound(activePlayers);
-            
-            if (getActivePlayers().size() > 1) {
-                std::cout << "\n  Нажмите Enter для продолжения...";
-                std::cin.get();
+private:
+    static constexpr size_t kNoWinner = std::numeric_limits<size_t>::max();
+    
+    struct Outcome {
+        size_t winner = kNoWinner;
+        int rounds = 0;
+        int targetRound = 0;  // раунд выбывания player, 0 - не выбыл
+    };
+    
+    Outcome playBranch(const Game& base, size_t branch, bool intervene) const {
+        CounterRng rng({options_.seed, static_cast<uint32_t>(settings_.round), DrawKey::kService,
+                        static_cast<uint32_t>(branch), 0, DrawKey::WHAT_IF});
+        auto game = base.fork((uint64_t{rng()} << 32) | rng());
+        if (intervene) {
+            if (auto* bot = dynamic_cast<ComputerPlayer*>(game->mutablePlayer(settings_.player))) {
+                bot->forceNextChoice(settings_.choice);
             }
         }
+        game->run();
         
-        auto finalPlayers = getActivePlayers();
-        if (!finalPlayers.empty()) {
-            std::cout << "\n" << std::string(60, '=') << "\n";
-            std::cout << "  ПОБЕДИТЕЛЬ: " << finalPlayers[0]->getName() << "\n";
-            std::cout << std::string(60, '=') << "\n";
-        } else {
-            std::cout << "\n  Все игроки выбыли одновременно, ничья\n";
+        Outcome outcome;
+        outcome.rounds = game->rounds();
+        for (size_t slot = 0; slot < game->numPlayers(); ++slot) {
+            if (game->player(slot).isActive()) {
+                outcome.winner = slot;
+            }
+        }
+        if (settings_.player != WhatIfSettings::kNoPlayer) {
+            outcome.targetRound = game->player(settings_.player).getEliminatedRound();
+        }
+        return outcome;
+    }
+    
+    void printTarget(const std::string& label, const std::string& name,
+                     const std::vector<Outcome>& outcomes, size_t variant) const {
+        size_t wins = 0, eliminated = 0;
+        double round = 0.0;
+        for (size_t b = 0; b < settings_.branches; ++b) {
+            const Outcome& outcome = outcomes[2 * b + variant];
+            if (outcome.winner == settings_.player) {
+                wins++;
+            }
+            if (outcome.targetRound > 0) {
+                eliminated++;
+                round += outcome.targetRound;
+            }
         }
+        std::cout << "  " << name << ", " << label << ": побед " << wins << " из "
+                  << settings_.branches;
+        if (eliminated > 0) {
+            std::cout << ", выбывает в среднем в раунде " << std::setprecision(2)
+                      << round / eliminated;
+        }
+        std::cout << "\n";
     }
+    
+    GameOptions options_;
+    WhatIfSettings settings_;
 };
 
 
-int main() {
-    Game game;
+GameOptions parseOptions(int argc, char* argv[]) {
+    GameOptions options;
+    options.seed = (uint64_t{std::random_device{}()} << 32) | std::random_device{}();
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) {
+            options.seed = std::stoull(argv[++i]);
+        } else if (arg == "--elimination" && i + 1 < argc) {
+            options.elimination = EliminationPolicy::parse(argv[++i]);
+        } else if (arg == "--group-size" && i + 1 < argc) {
+            options.groupSize = std::stoul(argv[++i]);
+            if (options.groupSize == 1) {
+                throw std::invalid_argument("размер группы должен быть 0 или не меньше 2");
+            }
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = std::max(1ul, std::stoul(argv[++i]));
+        } else if (arg == "--quiet") {
+            options.quiet = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            options.tracePath = argv[++i];
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            options.metricsAddress = argv[++i];
+        } else if (arg == "--scoring" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine == "auto") {
+                options.scoring = GameOptions::Scoring::AUTO;
+            } else if (engine == "pairwise") {
+                options.scoring = GameOptions::Scoring::PAIRWISE;
+            } else if (engine == "histogram") {
+                options.scoring = GameOptions::Scoring::HISTOGRAM;
+            } else {
+                throw std::invalid_argument("неизвестный подсчёт очков " + engine);
+            }
+        } else if (arg == "--prefetch" && i + 1 < argc) {
+            options.prefetch = std::stoul(argv[++i]);
+        } else if (arg == "--group-layout") {
+            options.groupLayout = true;
+        } else if (arg == "--huge-pages" && i + 1 < argc) {
+            options.hugePages = HugePages::parse(argv[++i]);
+        } else if (arg == "--what-if" && i + 1 < argc) {
+            options.mode = GameOptions::Mode::WHAT_IF;
+            options.whatIf = WhatIfSettings::parse(argv[++i]);
+        } else if (arg == "--bench" && i + 1 < argc) {
+            options.mode = GameOptions::Mode::BENCH;
+            options.bench = BenchSettings::parse(argv[++i]);
+        } else if (arg == "--verify-scoring" && i + 1 < argc) {
+            options.mode = GameOptions::Mode::VERIFY_SCORING;
+            options.verify = VerifySettings::parse(argv[++i]);
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--check-allocations") {
+            options.mode = GameOptions::Mode::CHECK_ALLOCATIONS;
+        } else if (arg == "--check-metrics") {
+            options.mode = GameOptions::Mode::CHECK_METRICS;
+        } else if (arg == "--export" && i + 1 < argc) {
+            options.exportPath = argv[++i];
+        } else if (arg == "--io-backend" && i + 1 < argc) {
+            options.ioBackend = AsyncFileWriter::parseBackend(argv[++i]);
+        } else if (arg == "--read-export" && i + 1 < argc) {
+            options.mode = GameOptions::Mode::READ_EXPORT;
+            options.exportPath = argv[++i];
+        } else if (arg == "--evolve" && i + 1 < argc) {
+            options.mode = GameOptions::Mode::EVOLVE;
+            options.evolution = EvolutionSettings::parse(argv[++i]);
+        } else if (arg == "--replicator" && i + 1 < argc) {
+            options.mode = GameOptions::Mode::REPLICATOR;
+            options.replicator = ReplicatorSettings::parse(argv[++i]);
+        } else {
+            throw std::invalid_argument("неизвестный параметр " + arg);
+        }
+    }
+    
+    return options;
+}
+
+
+int main(int argc, char* argv[]) {
+    GameOptions options;
+    try {
+        options = parseOptions(argc, argv);
+        if (!options.tracePath.empty()) {
+            Trace::start();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "\n  Ошибка параметров: " << e.what() << "\n";
+        return 1;
+    }
+    
+    HugePages::setMode(options.hugePages);
+    
+    std::unique_ptr<MetricsServer> metrics;
+    if (!options.metricsAddress.empty()) {
+        try {
+            Metrics::enable();
+            metrics = std::make_unique<MetricsServer>(options.metricsAddress);
+            if (options.metricsAddress == "0") {
+                std::cerr << "  Метрики: http://127.0.0.1:" << metrics->port() << "/metrics\n";
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "\n  Ошибка: " << e.what() << "\n";
+            return 1;
+        }
+    }
+    
+    if (options.mode == GameOptions::Mode::CHECK_ALLOCATIONS) {
+        return AllocationCheck::run(options.seed) ? 0 : 1;
+    }
+    
+    if (options.mode == GameOptions::Mode::CHECK_METRICS) {
+        return MetricsCheck::run() ? 0 : 1;
+    }
+    
+    if (options.mode == GameOptions::Mode::VERIFY_SCORING) {
+        return ScoringVerifier(options).run() ? 0 : 1;
+    }
+    
+    if (options.mode == GameOptions::Mode::WHAT_IF) {
+        try {
+            WhatIf(options).run();
+        } catch (const std::exception& e) {
+            std::cerr << "\n  Ошибка: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    
+    if (options.mode == GameOptions::Mode::BENCH) {
+        try {
+            ScalingBench(options).run();
+        } catch (const std::exception& e) {
+            std::cerr << "\n  Ошибка: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    
+    if (options.mode == GameOptions::Mode::EVOLVE) {
+        try {
+            Evolution(options).run();
+            if (!options.tracePath.empty()) {
+                Trace::write(options.tracePath);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "\n  Ошибка: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    
+    if (options.mode == GameOptions::Mode::REPLICATOR) {
+        const auto& settings = options.replicator;
+        std::cout << "\n  Репликаторная динамика: зерно " << options.seed << ", видов " << settings.types
+                  << ", шагов " << settings.steps << ", dt " << settings.dt << ", популяция "
+                  << (settings.population ? std::to_string(settings.population) : "бесконечная") << "\n";
+        ReplicatorDynamics::fromSettings(settings, options.seed)
+            .run(settings.steps, settings.report, options.seed);
+        return 0;
+    }
+    
+    if (options.mode == GameOptions::Mode::READ_EXPORT) {
+        try {
+            auto summary = ExportReader::scan(options.exportPath, options.threads);
+            std::cout << "\n  " << options.exportPath << ": " << summary.rows << " строк в "
+                      << summary.chunks << " чанках, игроков " << summary.players
+                      << ", раундов " << summary.maxRound << "\n";
+            std::cout << "  Выборы:";
+            for (Choice choice : ChoiceHelper::allChoices()) {
+                std::cout << " " << ChoiceHelper::toString(choice) << " "
+                          << summary.choices[ChoiceHelper::index(choice)];
+            }
+            std::cout << "\n  Побед " << summary.wins << ", поражений " << summary.losses << "\n";
+            std::cout << "  Размер " << summary.fileBytes << " байт, в CSV было бы "
+                      << summary.csvBytes << " байт\n";
+        } catch (const std::exception& e) {
+            std::cerr << "\n  Ошибка: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
     
     try {
+        Game game(options);
         game.setup();
         game.run();
+        if (!options.tracePath.empty()) {
+            Trace::write(options.tracePath);
+            std::cout << "\n  Трасса записана в " << options.tracePath << "\n";
+        }
     } catch (const std::exception& e) {
         std::cerr << "\n  Ошибка: " << e.what() << "\n";
     }